@@ -0,0 +1,103 @@
+#ifndef GC_PROJECT_ARENA_H
+#define GC_PROJECT_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "gc/log.h"
+#include "gc/numa.h"
+
+inline size_t arena_page_size() {
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return page_size;
+}
+
+inline size_t arena_round_up(size_t size, size_t align) {
+    return (size + align - 1) & ~(align - 1);
+}
+
+// Anonymous mappings are zero-filled and committed lazily by the kernel. With `node` the pages
+// are preferably taken from that NUMA node, whichever thread touches them first.
+inline void* arena_map(size_t size, int node = -1) {
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        LOG_WARNING("Failed to map arena of size %lu", size);
+        return NULL;
+    }
+    numa_bind(mem, size, node);
+    return mem;
+}
+
+// Size of a transparent huge page, 0 when THP is disabled or not supported by the kernel.
+inline size_t arena_huge_page_size() {
+    static const size_t huge_size = []() -> size_t {
+        FILE* in = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+        if (in == NULL) { return 0; }
+        char buf[128];
+        size_t len = fread(buf, 1, sizeof(buf) - 1, in);
+        fclose(in);
+        buf[len] = '\0';
+        if (strstr(buf, "[never]") != NULL) { return 0; }
+
+        size_t size = 2 * 1024 * 1024;
+        in = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+        if (in != NULL)
+        {
+            unsigned long pmd_size;
+            if (fscanf(in, "%lu", &pmd_size) == 1 && pmd_size > 0) { size = pmd_size; }
+            fclose(in);
+        }
+        return size;
+    }();
+    return huge_size;
+}
+
+// Like arena_map, but `size` is rounded up to whole huge pages, the mapping is aligned to a huge page and
+// the kernel is asked to back it with huge pages. Falls back to a regular mapping when THP is unavailable,
+// `huge` tells which one was made.
+inline void* arena_map_huge(size_t& size, int node, bool& huge) {
+    huge = false;
+    size_t huge_size = arena_huge_page_size();
+    if (huge_size == 0) { return arena_map(size, node); }
+
+    size = arena_round_up(size, huge_size);
+    char* mem = static_cast<char*>(arena_map(size + huge_size));
+    if (mem == NULL) { return NULL; }
+
+    // Trims the mapping to the aligned part
+    char* aligned = reinterpret_cast<char*>(arena_round_up(reinterpret_cast<uintptr_t>(mem), huge_size));
+    if (aligned != mem)
+    {
+        munmap(mem, aligned - mem);
+    }
+    munmap(aligned + size, mem + huge_size - aligned);
+
+    numa_bind(aligned, size, node);
+    if (madvise(aligned, size, MADV_HUGEPAGE) == 0)
+    {
+        huge = true;
+    } else
+    {
+        LOG_DEBUG("Huge pages were refused for arena %p", aligned);
+    }
+    return aligned;
+}
+
+inline void arena_unmap(void* mem, size_t size) {
+    munmap(mem, size);
+}
+
+// Gives the pages in [begin, end) back to the kernel. They read as zero when touched again.
+inline void arena_decommit(void* begin, void* end) {
+    uintptr_t first = arena_round_up(reinterpret_cast<uintptr_t>(begin), arena_page_size());
+    uintptr_t last = reinterpret_cast<uintptr_t>(end) & ~(arena_page_size() - 1);
+    if (first >= last) { return; }
+    madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+}
+
+#endif //GC_PROJECT_ARENA_H
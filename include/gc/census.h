@@ -0,0 +1,44 @@
+#ifndef GC_PROJECT_CENSUS_H
+#define GC_PROJECT_CENSUS_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <utility>
+#include <vector>
+
+#include "gc/gc.h"
+
+// Heap census. Every collection counts the survivors it walks anyway, and publishes the result together with
+// the occupancy of the heap's arenas, so reading a census never touches a heap.
+
+inline size_t census_class(size_t size) {
+    if (size <= 16) { return 0; }
+    size_t cls = (64 - __builtin_clzll(size - 1)) - 4;
+    return cls < GC_CENSUS_CLASSES ? cls : GC_CENSUS_CLASSES - 1;
+}
+
+inline void census_add_object(gc_census& census, size_t size) {
+    size_t cls = census_class(size);
+    ++census.objects;
+    census.bytes += size;
+    ++census.class_objects[cls];
+    census.class_bytes[cls] += size;
+    if (size >= GC_CENSUS_LARGE_BYTES)
+    {
+        ++census.large_objects;
+        census.large_bytes += size;
+    }
+}
+
+// Adds a page holding `used` of its `page` bytes to the occupancy histogram.
+inline void census_add_page(gc_census& census, size_t used, size_t page) {
+    size_t bucket = used == 0 ? 0 : (used * 10 + page - 1) / page;
+    ++census.arena_pages[bucket < GC_CENSUS_OCCUPANCY ? bucket : GC_CENSUS_OCCUPANCY - 1];
+}
+
+void census_merge(gc_census& total, const gc_census& part);
+void census_malloc_stats(gc_census& census);
+bool census_write(const char* path, int format, const std::vector<std::pair<pthread_t, gc_census>>& heaps,
+                  const gc_census& total);
+
+#endif //GC_PROJECT_CENSUS_H
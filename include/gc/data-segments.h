@@ -0,0 +1,123 @@
+#ifndef GC_PROJECT_DATA_SEGMENTS_H
+#define GC_PROJECT_DATA_SEGMENTS_H
+
+#include <link.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Writable segments of the executable and of the loaded shared objects: .data, .bss and whatever the linker
+// put next to them. Heaps created with GC_FLAG_SCAN_DATA treat their pointer-aligned words as roots.
+
+struct data_segment_list
+{
+    unsigned long long adds;    // dlpi_adds and dlpi_subs when the list was read
+    unsigned long long subs;
+    std::vector<std::pair<char*, char*>> ranges;
+};
+
+class data_segments {
+public:
+    // Passes every word of the segments to `visit` from inside dl_iterate_phdr, whose lock keeps dlclose from
+    // unmapping a library meanwhile. The list is read again only when libraries were loaded or unloaded since
+    // the last call. Must not run while the world is stopped, a stopped thread may hold that lock.
+    template<typename F>
+    void scan(F&& visit) {
+        scan_state<F> state{this, visit};
+        dl_iterate_phdr(&data_segments::scan_object<F>, &state);
+        if (state.next != NULL) { publish(state.next); }
+    }
+
+    void refresh() {
+        scan([](void*) {});
+    }
+
+    // Scans the list read by the last scan without the loader lock, for a stopped world and the snapshot child.
+    template<typename F>
+    void scan_cached(F&& visit) {
+        const data_segment_list* list = list_.load(std::memory_order_acquire);
+        if (list == NULL) { return; }
+        for (const auto& [begin, end] : list->ranges)
+        {
+            scan_words(begin, end, visit);
+        }
+    }
+
+private:
+    // Readers take the list without a lock, so replaced lists are kept: one may still be scanned.
+    std::atomic<const data_segment_list*> list_ = NULL;
+    std::mutex lists_mtx_;
+    std::vector<std::unique_ptr<data_segment_list>> lists_;
+
+    template<typename F>
+    struct scan_state
+    {
+        data_segments* self;
+        F& visit;
+        bool started = false;
+        data_segment_list* next = NULL;
+    };
+
+    template<typename F>
+    static void scan_words(char* begin, char* end, F& visit) {
+        uintptr_t first = (reinterpret_cast<uintptr_t>(begin) + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+        for (void** slot = reinterpret_cast<void**>(first); reinterpret_cast<char*>(slot + 1) <= end; ++slot)
+        {
+            visit(*slot);
+        }
+    }
+
+    template<typename F>
+    static int scan_object(struct dl_phdr_info* info, size_t, void* arg) {
+        auto state = static_cast<scan_state<F>*>(arg);
+        if (!state->started)
+        {
+            state->started = true;
+            const data_segment_list* list = state->self->list_.load(std::memory_order_acquire);
+            if (list != NULL && list->adds == info->dlpi_adds && list->subs == info->dlpi_subs)
+            {
+                for (const auto& [begin, end] : list->ranges)
+                {
+                    scan_words(begin, end, state->visit);
+                }
+                return 1;
+            }
+            state->next = new data_segment_list{info->dlpi_adds, info->dlpi_subs, {}};
+        }
+
+        // The collector's own globals are not roots, they only hold its bookkeeping
+        for (int i = 0; i < info->dlpi_phnum; i++)
+        {
+            if (contains(info, info->dlpi_phdr[i], state->self)) { return 0; }
+        }
+        for (int i = 0; i < info->dlpi_phnum; i++)
+        {
+            const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+            if (phdr.p_type != PT_LOAD || !(phdr.p_flags & PF_W)) { continue; }
+
+            char* begin = reinterpret_cast<char*>(info->dlpi_addr + phdr.p_vaddr);
+            char* end = begin + phdr.p_memsz;
+            state->next->ranges.push_back({begin, end});
+            scan_words(begin, end, state->visit);
+        }
+        return 0;
+    }
+
+    static bool contains(struct dl_phdr_info* info, const ElfW(Phdr)& phdr, const void* addr) {
+        if (phdr.p_type != PT_LOAD) { return false; }
+        uintptr_t begin = info->dlpi_addr + phdr.p_vaddr;
+        uintptr_t value = reinterpret_cast<uintptr_t>(addr);
+        return value >= begin && value < begin + phdr.p_memsz;
+    }
+
+    void publish(data_segment_list* list) {
+        std::lock_guard lists_lock(lists_mtx_);
+        lists_.emplace_back(list);
+        list_.store(list, std::memory_order_release);
+    }
+};
+
+#endif //GC_PROJECT_DATA_SEGMENTS_H
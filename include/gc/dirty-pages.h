@@ -0,0 +1,119 @@
+#ifndef GC_PROJECT_DIRTY_PAGES_H
+#define GC_PROJECT_DIRTY_PAGES_H
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <mutex>
+
+#include "gc/arena.h"
+
+// Kernel soft-dirty tracking: writing "4" to /proc/self/clear_refs clears the soft-dirty bit of every page
+// of the process, and the next write to a page sets it again (bit 55 of its /proc/self/pagemap entry).
+// The bits are per process, so they are cleared only when no budgeted cycle is relying on them; a cycle
+// that starts later sees the writes since an earlier clear, which is a superset of its own.
+
+#define PAGEMAP_SOFT_DIRTY (1ull << 55)
+#define PAGEMAP_WINDOW 512
+
+inline std::mutex dirty_mtx;
+inline int dirty_users = 0;
+
+inline bool dirty_clear() {
+    int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) { return false; }
+    bool ok = write(fd, "4", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+inline bool dirty_page_bit(int fd, const void* addr, bool& dirty) {
+    uint64_t entry;
+    off_t offset = static_cast<off_t>(reinterpret_cast<uintptr_t>(addr) / arena_page_size() * sizeof(entry));
+    if (pread(fd, &entry, sizeof(entry), offset) != sizeof(entry)) { return false; }
+    dirty = (entry & PAGEMAP_SOFT_DIRTY) != 0;
+    return true;
+}
+
+// Kernels without CONFIG_MEM_SOFT_DIRTY accept the clear but never set the bit. Called with dirty_mtx held
+// and no users, since the probe clears the bits.
+inline bool dirty_supported() {
+    static const bool supported = []() {
+        alignas(4096) static volatile char probe[4096];
+        probe[0] = 1;
+
+        int fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+        if (fd < 0) { return false; }
+        bool before = true;
+        bool after = false;
+        bool ok = dirty_clear() && dirty_page_bit(fd, const_cast<char*>(probe), before);
+        probe[0] = 2;
+        ok = ok && dirty_page_bit(fd, const_cast<char*>(probe), after);
+        close(fd);
+        return ok && !before && after;
+    }();
+    return supported;
+}
+
+// Starts tracking for one cycle. Returns false when soft-dirty bits are unavailable.
+inline bool dirty_begin() {
+    std::lock_guard dirty_lock(dirty_mtx);
+    if (dirty_users == 0)
+    {
+        if (!dirty_supported() || !dirty_clear()) { return false; }
+    }
+    ++dirty_users;
+    return true;
+}
+
+inline void dirty_end() {
+    std::lock_guard dirty_lock(dirty_mtx);
+    --dirty_users;
+}
+
+// Reads pagemap entries in windows of PAGEMAP_WINDOW pages, so ranges queried in address order cost about
+// one read per window. Ranges whose entries cannot be read are reported dirty.
+class dirty_reader {
+public:
+    dirty_reader() {
+        fd_ = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    }
+
+    dirty_reader(const dirty_reader&) = delete;
+    dirty_reader& operator=(const dirty_reader&) = delete;
+
+    bool is_dirty(const void* addr, size_t size) {
+        if (fd_ < 0) { return true; }
+
+        uintptr_t first = reinterpret_cast<uintptr_t>(addr) / arena_page_size();
+        uintptr_t last = (reinterpret_cast<uintptr_t>(addr) + (size > 0 ? size : 1) - 1) / arena_page_size();
+        for (uintptr_t page = first; page <= last; page++)
+        {
+            if (page < win_first_ || page >= win_first_ + win_cnt_)
+            {
+                ssize_t got = pread(fd_, win_, sizeof(win_), static_cast<off_t>(page * sizeof(uint64_t)));
+                if (got < static_cast<ssize_t>(sizeof(uint64_t)))
+                {
+                    win_cnt_ = 0;
+                    return true;
+                }
+                win_first_ = page;
+                win_cnt_ = static_cast<size_t>(got) / sizeof(uint64_t);
+            }
+            if (win_[page - win_first_] & PAGEMAP_SOFT_DIRTY) { return true; }
+        }
+        return false;
+    }
+
+    ~dirty_reader() {
+        if (fd_ >= 0) { close(fd_); }
+    }
+
+private:
+    int fd_;
+    uint64_t win_[PAGEMAP_WINDOW];
+    uintptr_t win_first_ = 0;
+    size_t win_cnt_ = 0;
+};
+
+#endif //GC_PROJECT_DIRTY_PAGES_H
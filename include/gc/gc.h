@@ -6,6 +6,7 @@ extern "C" {
 #endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <pthread.h>
 #include <signal.h>
@@ -14,6 +15,112 @@ extern "C" {
 
 #define GLOBAL 1
 #define THREAD_LOCAL 0
+#define GLOBAL_SNAPSHOT 2  // global collection marking a fork()-ed snapshot, Linux only
+
+// Flags of gc_create_ex
+#define GC_FLAG_BACKGROUND 1    // collect this heap from the background collector thread
+#define GC_FLAG_HUGE_PAGES 2    // back the heap's arenas with transparent huge pages
+#define GC_FLAG_DIRTY_PAGES 4   // budgeted cycles find objects written during marking by soft-dirty pages
+#define GC_FLAG_SCAN_DATA 8     // globals of the executable and loaded libraries are roots
+
+// errno value of an allocation refused because of a hard memory budget
+#define GC_EBUDGET EDQUOT
+
+// Heap that is not bound to any thread, used as a target or a source of gc_transfer.
+#define GC_ORPHAN_HEAP ((pthread_t)0)
+
+// All heaps, for gc_heap_census.
+#define GC_ALL_HEAPS ((pthread_t)-1)
+
+#define GC_CENSUS_CLASSES 24                // class i holds blocks of up to 16 << i bytes, the last one all larger
+#define GC_CENSUS_OCCUPANCY 11              // bucket 0 holds empty arena pages, bucket i pages up to i * 10% full
+#define GC_CENSUS_LARGE_BYTES (128 * 1024)  // malloc's default mmap threshold
+
+#define GC_CENSUS_TEXT 0
+#define GC_CENSUS_JSON 1
+
+// gc_handler entry points, for gc_latency_snapshot
+#define GC_OP_MALLOC 0
+#define GC_OP_FREE 1
+#define GC_OP_MARK_ROOT 2
+#define GC_OP_UNMARK_ROOT 3
+#define GC_OP_COLLECT 4
+#define GC_OP_WEAK_CREATE 5
+#define GC_OP_WEAK_GET 6
+#define GC_OP_WEAK_DESTROY 7
+#define GC_OP_MALLOC_MOVABLE 8
+#define GC_OP_PIN 9
+#define GC_OP_UNPIN 10
+#define GC_OP_REALLOC 11
+#define GC_OP_CALLOC 12
+#define GC_OP_MALLOC_ATOMIC 13
+#define GC_OP_MALLOC_RC 14
+#define GC_OP_RETAIN 15
+#define GC_OP_RELEASE 16
+#define GC_OP_CNT 17
+
+// Parts of a call's latency
+#define GC_LATENCY_TOTAL 0      // the whole call
+#define GC_LATENCY_BLOCKED 1    // waiting for a global collection started by another thread, or stopped by it
+#define GC_LATENCY_QUEUED 2     // waiting for a pool worker to pick up the call's task
+#define GC_LATENCY_COLLECT 3    // collecting, implicitly or on request
+#define GC_LATENCY_PARTS 4
+
+#define GC_LATENCY_SUB_BUCKETS 8
+#define GC_LATENCY_BUCKETS 320  // log-linear buckets of nanoseconds, see gc_latency_bucket_limit
+
+#define GC_TRACE_OFF 0
+#define GC_TRACE_PHASES 1
+#define GC_TRACE_OBJECTS 2
+
+typedef struct gc_weak_ref gc_weak_ref;
+
+// Handle of an object in the compacting space. The object may be moved by a global collection,
+// so the address has to be read through GC_DEREF every time unless the handle is pinned.
+typedef struct gc_handle_entry* gc_handle;
+
+// Node of an intrusive root list. The list is circular with a sentinel owned by the heap's thread,
+// the collector reads `ptr` of every node. Nodes must be linked by publishing `next` last.
+typedef struct gc_root_node
+{
+    void* ptr;
+    struct gc_root_node* prev;
+    struct gc_root_node* next;
+} gc_root_node;
+
+// Shape of a heap after its last collection. Arenas are the chunks of movable objects and regions,
+// the occupancy histogram covers their pages below the chunk tops.
+typedef struct gc_census
+{
+    unsigned long long collections;
+    unsigned long long objects;
+    unsigned long long bytes;
+    unsigned long long class_objects[GC_CENSUS_CLASSES];
+    unsigned long long class_bytes[GC_CENSUS_CLASSES];
+    unsigned long long large_objects;
+    unsigned long long large_bytes;
+    unsigned long long movable_objects;
+    unsigned long long movable_bytes;
+    unsigned long long arena_bytes;
+    unsigned long long arena_free_bytes;        // above the chunk tops
+    unsigned long long arena_fragmented_bytes;  // below the chunk tops, but not held by an object
+    unsigned long long arena_pages[GC_CENSUS_OCCUPANCY];
+    // malloc statistics of the whole process, filled in the total only
+    unsigned long long malloc_bytes;
+    unsigned long long malloc_used_bytes;
+    unsigned long long malloc_free_bytes;
+    unsigned long long malloc_fragmented_bytes; // free, but below the top of an arena, so it cannot be trimmed
+} gc_census;
+
+typedef struct gc_latency_hist
+{
+    unsigned long long count;
+    unsigned long long sum_ns;
+    unsigned long long max_ns;
+    unsigned long long buckets[GC_LATENCY_BUCKETS];
+} gc_latency_hist;
+
+typedef void(*gc_census_visitor)(pthread_t tid, const gc_census* census, void* arg);
 
 typedef struct gc_handler
 {
@@ -22,24 +129,114 @@ typedef struct gc_handler
     void(*mark_root)(pthread_t, void*);
     void(*unmark_root)(pthread_t, void*);
     void(*collect)(pthread_t, int);
+    gc_weak_ref*(*gc_weak_create)(pthread_t, void*);
+    void*(*gc_weak_get)(pthread_t, gc_weak_ref*);
+    void(*gc_weak_destroy)(pthread_t, gc_weak_ref*);
+    void(*gc_malloc_movable)(pthread_t, gc_handle*, size_t);
+    void(*gc_pin)(pthread_t, gc_handle);
+    void(*gc_unpin)(pthread_t, gc_handle);
+    void(*gc_realloc)(pthread_t, void**, size_t);
+    void(*gc_calloc)(pthread_t, void**, size_t, size_t);
+    void(*gc_malloc_atomic)(pthread_t, void**, size_t);
+    void(*gc_malloc_rc)(pthread_t, void**, size_t);
+    void(*gc_retain)(pthread_t, void*);
+    void(*gc_release)(pthread_t, void*);
 } gc_handler;
 
 gc_handler gc_create(pthread_t tid);
+gc_handler gc_create_ex(pthread_t tid, int flags);
 gc_handler gc_get_handler();
+// Name of the collector configuration the linked library was built with: "default", "throughput",
+// "low-latency" or "debug".
+const char* gc_get_config();
 void gc_stop(pthread_t tid);
 unsigned long long int gc_get_allocs_cnt(pthread_t tid);
 unsigned long long int gc_get_roots_cnt(pthread_t tid);
 unsigned long long int gc_gel_all_threads_allocs_cnt();
 
+int gc_collect_budget(pthread_t tid, int flag, uint64_t max_ns);
+
+// Frees the reference counted objects whose count is 0 and that no root refers to, returns their number.
+unsigned long long int gc_rc_flush(pthread_t tid);
+
+int gc_set_budget(pthread_t tid, size_t soft_bytes, size_t hard_bytes);
+int gc_set_process_budget(size_t soft_bytes, size_t hard_bytes);
+unsigned long long int gc_get_live_bytes(pthread_t tid);
+unsigned long long int gc_get_process_live_bytes();
+// Bytes of the heap's arenas mapped with huge page advice, 0 without GC_FLAG_HUGE_PAGES or when THP is unavailable.
+unsigned long long int gc_get_huge_page_bytes(pthread_t tid);
+
+void gc_set_root_list(pthread_t tid, gc_root_node* head);
+
+// from_tid must be the calling thread or GC_ORPHAN_HEAP, and tid of gc_adopt_on_stop the calling thread.
+long long int gc_transfer(pthread_t from_tid, pthread_t to_tid, void* root);
+int gc_adopt_on_stop(pthread_t tid, pthread_t heir_tid);
+
+int gc_region_begin(pthread_t tid);
+int gc_region_end(pthread_t tid);
+void* gc_region_promote(pthread_t tid, void* ptr);
+
+int gc_profiler_start(size_t sample_bytes, const char* report_path);
+void gc_profiler_stop();
+int gc_profiler_dump(const char* path);
+
+int gc_record_start(const char* path);
+void gc_record_stop();
+
+// Collects every heap and gives memory back to the kernel when the system is short of memory. NULL paths
+// mean /proc/pressure/memory and the process's cgroup v2 directory, an empty cgroup_dir disables the limit check.
+int gc_pressure_start(const char* psi_path, const char* cgroup_dir);
+void gc_pressure_stop();
+unsigned long long int gc_pressure_events();
+
+int gc_heap_census(pthread_t tid, gc_census* total, gc_census_visitor visit, void* arg);
+int gc_census_dump(const char* path, int format);
+int gc_census_on_signal(int signo, const char* path, int format);
+
+int gc_latency_start();
+void gc_latency_stop();
+int gc_latency_snapshot(int op, int part, gc_latency_hist* hist);
+// Largest value counted in `bucket`.
+unsigned long long int gc_latency_bucket_limit(int bucket);
+unsigned long long int gc_latency_percentile(const gc_latency_hist* hist, double quantile);
+
+int gc_trace_start(const char* path, int level);
+void gc_trace_set_level(int level);
+void gc_trace_stop();
+
 void handle_sigusr1(int sig);
 
 
 #define GC_CREATE()                                                         \
     gc_create(pthread_self());
 
+#define GC_CREATE_EX(flags)                                                 \
+    gc_create_ex(pthread_self(), (flags));
+
 #define GC_MALLOC(val, size)                                                \
     gc_get_handler().gc_malloc(pthread_self(), (void**)(&(val)), (size));
 
+#define GC_MALLOC_ATOMIC(val, size)                                         \
+    gc_get_handler().gc_malloc_atomic(pthread_self(), (void**)(&(val)), (size));
+
+#define GC_MALLOC_RC(val, size)                                             \
+    gc_get_handler().gc_malloc_rc(pthread_self(), (void**)(&(val)), (size));
+
+#define GC_RETAIN(ptr)                                                      \
+    gc_get_handler().gc_retain(pthread_self(), (void*)(ptr));
+
+#define GC_RELEASE(ptr)                                                     \
+    gc_get_handler().gc_release(pthread_self(), (void*)(ptr));
+
+#define GC_RC_FLUSH()                                                       \
+    gc_rc_flush(pthread_self());
+
+#define GC_CALLOC(val, nmemb, size)                                         \
+    gc_get_handler().gc_calloc(pthread_self(), (void**)(&(val)), (nmemb), (size));
+
+#define GC_REALLOC(val, size)                                               \
+    gc_get_handler().gc_realloc(pthread_self(), (void**)(&(val)), (size));
+
 #define GC_MARK_ROOT(val)                                                   \
     gc_get_handler().mark_root(pthread_self(), (void*)(&(val)));
 
@@ -49,12 +246,45 @@ void handle_sigusr1(int sig);
 #define GC_COLLECT(flag)                                                    \
     gc_get_handler().collect(pthread_self(), (flag));
 
+#define GC_COLLECT_BUDGET(flag, max_ns)                                     \
+    gc_collect_budget(pthread_self(), (flag), (max_ns));
+
 #define GC_STOP()                                                           \
     gc_stop(pthread_self());
 
 #define GC_FREE(ptr)                                                        \
     gc_get_handler().gc_free(pthread_self(), (void*)(ptr));
 
+#define GC_WEAK_CREATE(ptr)                                                 \
+    gc_get_handler().gc_weak_create(pthread_self(), (void*)(ptr));
+
+#define GC_WEAK_GET(ref)                                                    \
+    gc_get_handler().gc_weak_get(pthread_self(), (ref));
+
+#define GC_WEAK_DESTROY(ref)                                                \
+    gc_get_handler().gc_weak_destroy(pthread_self(), (ref));
+
+#define GC_MALLOC_MOVABLE(handle, size)                                     \
+    gc_get_handler().gc_malloc_movable(pthread_self(), &(handle), (size));
+
+#define GC_PIN(handle)                                                      \
+    gc_get_handler().gc_pin(pthread_self(), (handle));
+
+#define GC_UNPIN(handle)                                                    \
+    gc_get_handler().gc_unpin(pthread_self(), (handle));
+
+#define GC_DEREF(handle)                                                    \
+    (*(void**)(handle))
+
+#define GC_REGION_BEGIN()                                                   \
+    gc_region_begin(pthread_self());
+
+#define GC_REGION_END()                                                     \
+    gc_region_end(pthread_self());
+
+#define GC_REGION_PROMOTE(ptr)                                              \
+    gc_region_promote(pthread_self(), (void*)(ptr));
+
 #define GC_GET_ALLOCS_CNT()                                                 \
     gc_get_allocs_cnt(pthread_self());
 
@@ -0,0 +1,259 @@
+#ifndef GC_PROJECT_GC_HPP
+#define GC_PROJECT_GC_HPP
+
+// Header-only C++20 layer over the C API.
+//
+// gc::root<T> is a typed pointer that is a root while it is alive. Roots of a thread are kept in an
+// intrusive list that the collector walks directly, so creating, moving and destroying a root is a
+// few pointer stores with no call into the library. gc::ptr<T> is a typed pointer for fields of
+// collected objects, it does not root anything. Roots belong to the thread that created them.
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "gc/gc.h"
+
+namespace gc {
+
+// Objects of pointer-free types are allocated with gc_malloc_atomic and never scanned.
+// Specialize for own types that hold no pointers to collected memory.
+template<typename T>
+struct is_pointer_free : std::bool_constant<std::is_arithmetic_v<T> || std::is_enum_v<T>> {};
+
+template<typename T, size_t N>
+struct is_pointer_free<T[N]> : is_pointer_free<T> {};
+
+namespace detail {
+
+// Function pointers of the handler never change, so it is built once instead of on every call.
+inline const gc_handler& handler() {
+    static const gc_handler cached = gc_get_handler();
+    return cached;
+}
+
+struct root_list
+{
+    gc_root_node head;
+
+    root_list() {
+        head.ptr = nullptr;
+        head.prev = &head;
+        head.next = &head;
+    }
+};
+
+inline gc_root_node* roots() {
+    thread_local root_list list;
+    return &list.head;
+}
+
+// The owner may be stopped by a signal at any point and the list walked forwards, so the store that
+// makes a node reachable through `next` comes last, and the compiler must not move it.
+inline void link(gc_root_node* node, gc_root_node* prev) {
+    gc_root_node* next = prev->next;
+    node->prev = prev;
+    node->next = next;
+    std::atomic_signal_fence(std::memory_order_release);
+    prev->next = node;
+    next->prev = node;
+}
+
+inline void unlink(gc_root_node* node) {
+    node->prev->next = node->next;
+    std::atomic_signal_fence(std::memory_order_release);
+    node->next->prev = node->prev;
+    node->prev = nullptr;
+    node->next = nullptr;
+}
+
+// `node` takes the place of `old` in the list.
+inline void replace(gc_root_node* node, gc_root_node* old) {
+    node->prev = old->prev;
+    node->next = old->next;
+    std::atomic_signal_fence(std::memory_order_release);
+    old->prev->next = node;
+    node->next->prev = node;
+    old->prev = nullptr;
+    old->next = nullptr;
+}
+
+} // namespace detail
+
+template<typename T>
+class ptr {
+public:
+    ptr() = default;
+    ptr(std::nullptr_t) {}
+    explicit ptr(T* p) : p_(p) {}
+
+    T* get() const { return p_; }
+    T& operator*() const { return *p_; }
+    T* operator->() const { return p_; }
+    T& operator[](size_t idx) const { return p_[idx]; }
+    explicit operator bool() const { return p_ != nullptr; }
+    bool operator==(const ptr&) const = default;
+
+private:
+    T* p_ = nullptr;
+};
+
+template<typename T>
+class root {
+public:
+    root() {
+        node_.ptr = nullptr;
+        detail::link(&node_, detail::roots());
+    }
+
+    root(std::nullptr_t) : root() {}
+
+    explicit root(T* p) {
+        node_.ptr = p;
+        detail::link(&node_, detail::roots());
+    }
+
+    root(ptr<T> p) : root(p.get()) {}
+
+    root(const root& other) : root(other.get()) {}
+
+    // The new root takes the place of `other` in the list, `other` is left empty and unlinked.
+    root(root&& other) noexcept {
+        node_.ptr = other.node_.ptr;
+        if (other.node_.next != nullptr)
+        {
+            detail::replace(&node_, &other.node_);
+        } else
+        {
+            detail::link(&node_, detail::roots());
+        }
+        other.node_.ptr = nullptr;
+    }
+
+    root& operator=(const root& other) {
+        return *this = other.get();
+    }
+
+    root& operator=(root&& other) noexcept {
+        *this = other.get();
+        other.node_.ptr = nullptr;
+        return *this;
+    }
+
+    root& operator=(T* p) {
+        node_.ptr = p;
+        if (node_.next == nullptr)
+        {
+            detail::link(&node_, detail::roots());
+        }
+        return *this;
+    }
+
+    root& operator=(ptr<T> p) {
+        return *this = p.get();
+    }
+
+    ~root() {
+        if (node_.next != nullptr)
+        {
+            detail::unlink(&node_);
+        }
+    }
+
+    T* get() const { return static_cast<T*>(node_.ptr); }
+    T& operator*() const { return *get(); }
+    T* operator->() const { return get(); }
+    T& operator[](size_t idx) const { return get()[idx]; }
+    explicit operator bool() const { return node_.ptr != nullptr; }
+    operator ptr<T>() const { return ptr<T>(get()); }
+
+    // Variable the library writes a new allocation to. It is rooted before the allocation happens.
+    void** slot() { return &node_.ptr; }
+
+private:
+    gc_root_node node_;
+};
+
+// Allocates and constructs a T. Collected objects are freed without running destructors.
+// On failure the returned root is empty and errno is set like for gc_malloc.
+template<typename T, typename... Args>
+root<T> make(Args&&... args) {
+    static_assert(std::is_trivially_destructible_v<T>, "collected objects are freed without running destructors");
+
+    root<T> res;
+    if constexpr (is_pointer_free<T>::value)
+    {
+        detail::handler().gc_malloc_atomic(pthread_self(), res.slot(), sizeof(T));
+    } else
+    {
+        // Zeroed, so that padding and unset fields do not look like pointers to the conservative scan
+        detail::handler().gc_calloc(pthread_self(), res.slot(), 1, sizeof(T));
+    }
+    if (res)
+    {
+        ::new (static_cast<void*>(res.get())) T(std::forward<Args>(args)...);
+    }
+    return res;
+}
+
+// Allocates `cnt` value-initialized elements.
+template<typename T>
+root<T> make_array(size_t cnt) {
+    static_assert(std::is_trivially_destructible_v<T>, "collected objects are freed without running destructors");
+
+    root<T> res;
+    if constexpr (is_pointer_free<T>::value)
+    {
+        if (cnt > SIZE_MAX / sizeof(T))
+        {
+            errno = ENOMEM;
+            return res;
+        }
+        detail::handler().gc_malloc_atomic(pthread_self(), res.slot(), cnt * sizeof(T));
+    } else
+    {
+        detail::handler().gc_calloc(pthread_self(), res.slot(), cnt, sizeof(T));
+    }
+    if (res)
+    {
+        for (size_t i = 0; i < cnt; i++)
+        {
+            ::new (static_cast<void*>(res.get() + i)) T();
+        }
+    }
+    return res;
+}
+
+inline void collect(int flag = THREAD_LOCAL) {
+    detail::handler().collect(pthread_self(), flag);
+}
+
+// Registers the root list of the calling thread with its heap, needed when the heap was created
+// through the C API.
+inline void attach() {
+    gc_set_root_list(pthread_self(), detail::roots());
+}
+
+// Heap of the calling thread for the lifetime of the object.
+class thread_heap {
+public:
+    explicit thread_heap(int flags = 0) {
+        gc_create_ex(pthread_self(), flags);
+        attach();
+    }
+
+    thread_heap(const thread_heap&) = delete;
+    thread_heap& operator=(const thread_heap&) = delete;
+
+    ~thread_heap() {
+        gc_stop(pthread_self());
+    }
+};
+
+} // namespace gc
+
+#endif //GC_PROJECT_GC_HPP
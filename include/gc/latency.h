@@ -0,0 +1,85 @@
+#ifndef GC_PROJECT_LATENCY_H
+#define GC_PROJECT_LATENCY_H
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+
+#include "gc/gc.h"
+
+// Latency of gc_handler entry points, split into the parts of GC_LATENCY_*. A call owns a latency_scope
+// on the caller's stack. Pool workers running its task, the signal handler of a stopped thread and the
+// collector add their time to that scope through latency_current, and the call records it on return.
+
+extern std::atomic<bool> latency_on;
+
+inline uint64_t latency_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+struct latency_scope
+{
+    int op;
+    uint64_t start_ns;
+    uint64_t parts[GC_LATENCY_PARTS];
+    latency_scope* prev;
+};
+
+// Scope of the call the current thread works for, NULL when it works for none or latency is off.
+extern thread_local latency_scope* latency_current;
+
+void latency_record(const latency_scope& scope, uint64_t end_ns);
+
+class latency_call {
+public:
+    explicit latency_call(int op) {
+        if (!latency_on.load(std::memory_order_relaxed)) [[likely]] { return; }
+
+        active_ = true;
+        scope_.op = op;
+        scope_.start_ns = latency_now();
+        for (auto& part : scope_.parts)
+        {
+            part = 0;
+        }
+        scope_.prev = latency_current;
+        latency_current = &scope_;
+    }
+
+    latency_call(const latency_call&) = delete;
+    latency_call& operator=(const latency_call&) = delete;
+
+    ~latency_call() {
+        if (!active_) { return; }
+        latency_current = scope_.prev;
+        latency_record(scope_, latency_now());
+    }
+
+private:
+    latency_scope scope_;
+    bool active_ = false;
+};
+
+// Adds the time from construction to destruction to `part` of the current call, if there is one.
+class latency_part {
+public:
+    explicit latency_part(int part) : scope_(latency_current), part_(part) {
+        if (scope_ != NULL) [[unlikely]] { start_ns_ = latency_now(); }
+    }
+
+    latency_part(const latency_part&) = delete;
+    latency_part& operator=(const latency_part&) = delete;
+
+    ~latency_part() {
+        if (scope_ != NULL) [[unlikely]] { scope_->parts[part_] += latency_now() - start_ns_; }
+    }
+
+private:
+    latency_scope* scope_;
+    int part_;
+    uint64_t start_ns_ = 0;
+};
+
+#endif //GC_PROJECT_LATENCY_H
@@ -2,7 +2,12 @@
 #define MINUNIT_H
 
 #define MU_ASSERT(test, message) do { if (!(test)) return message; } while (0)
+#ifdef __cplusplus
+/* String literals are const in C++, so tests there return const char* */
+#define MU_RUN_TEST(test) do { const char *message = test(); tests_run++; if (message) return message; } while (0)
+#else
 #define MU_RUN_TEST(test) do { char *message = test(); tests_run++; if (message) return message; } while (0)
+#endif
 
 extern int tests_run;
 
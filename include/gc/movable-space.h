@@ -0,0 +1,352 @@
+#ifndef GC_PROJECT_MOVABLE_SPACE_H
+#define GC_PROJECT_MOVABLE_SPACE_H
+
+#include <string.h>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+
+#include "gc/arena.h"
+#include "gc/census.h"
+
+#define MOVABLE_CHUNK_SIZE (1024 * 1024)
+#define MOVABLE_HANDLES_MAX (1024 * 1024)
+#define MOVABLE_ALIGN 16
+
+enum MOVABLE_FLAG : uint32_t {
+    MOVABLE_MARKED = 1,
+    MOVABLE_PINNED = 2,
+};
+
+// Entry of the indirection table. `addr` has to stay the first member, GC_DEREF reads it directly.
+struct gc_handle_entry
+{
+    void* addr;
+    size_t size;
+    uint32_t flags;
+    uint32_t pin_cnt;
+};
+
+// Memory of a chunk above `top` always reads as zero, so new objects need no clearing.
+struct movable_chunk
+{
+    char* base;
+    size_t cap;
+    size_t top;
+    std::vector<gc_handle_entry*> objs;     // sorted by address
+    bool huge;                              // mapped with huge page advice
+};
+
+class movable_space {
+public:
+    movable_space() = default;
+    movable_space(const movable_space&) = delete;
+    movable_space& operator=(const movable_space&) = delete;
+
+    gc_handle_entry* allocate(size_t size) {
+        if (table_ == NULL)
+        {
+            table_ = static_cast<gc_handle_entry*>(arena_map(MOVABLE_HANDLES_MAX * sizeof(gc_handle_entry), node_));
+            if (table_ == NULL) { return NULL; }
+        }
+
+        gc_handle_entry* entry = new_entry();
+        if (entry == NULL) { return NULL; }
+
+        size_t aligned_size = arena_round_up(size > 0 ? size : 1, MOVABLE_ALIGN);
+        if (cur_ == NULL || cur_->cap - cur_->top < aligned_size)
+        {
+            cur_ = new_chunk(aligned_size);
+            if (cur_ == NULL)
+            {
+                free_entries_.push_back(entry);
+                return NULL;
+            }
+        }
+
+        entry->addr = cur_->base + cur_->top;
+        entry->size = size;
+        entry->flags = 0;
+        entry->pin_cnt = 0;
+        cur_->top += aligned_size;
+        cur_->objs.push_back(entry);
+        ++cnt_;
+        return entry;
+    }
+
+    void release(gc_handle_entry* entry) {
+        movable_chunk* chunk = find_chunk(entry->addr);
+        auto itr = std::lower_bound(chunk->objs.begin(), chunk->objs.end(), entry, [](auto lhs, auto rhs) {
+            return lhs->addr < rhs->addr;
+        });
+        chunk->objs.erase(itr);
+        pinned_.erase(entry);
+        drop_entry(entry);
+    }
+
+    // Returns the entry if `ptr` is a live handle.
+    gc_handle_entry* find_handle(void* ptr) {
+        char* p = static_cast<char*>(ptr);
+        char* table_begin = reinterpret_cast<char*>(table_);
+        if (p < table_begin || p >= table_begin + table_used_ * sizeof(gc_handle_entry)) { return NULL; }
+        if ((p - table_begin) % sizeof(gc_handle_entry) != 0) { return NULL; }
+
+        gc_handle_entry* entry = reinterpret_cast<gc_handle_entry*>(ptr);
+        return entry->addr != NULL ? entry : NULL;
+    }
+
+    // Returns the entry of the object `ptr` points into.
+    gc_handle_entry* find_object(void* ptr) {
+        movable_chunk* chunk = find_chunk(ptr);
+        if (chunk == NULL || static_cast<char*>(ptr) >= chunk->base + chunk->top) { return NULL; }
+
+        auto itr = std::upper_bound(chunk->objs.begin(), chunk->objs.end(), ptr, [](void* p, auto entry) {
+            return p < entry->addr;
+        });
+        if (itr == chunk->objs.begin()) { return NULL; }
+        --itr;
+
+        char* begin = static_cast<char*>((*itr)->addr);
+        return static_cast<char*>(ptr) < begin + std::max<size_t>((*itr)->size, 1) ? *itr : NULL;
+    }
+
+    void pin(gc_handle_entry* entry) {
+        ++entry->pin_cnt;
+        pinned_.insert(entry);
+    }
+
+    void unpin(gc_handle_entry* entry) {
+        if (entry->pin_cnt == 0) { return; }
+        if (--entry->pin_cnt == 0)
+        {
+            pinned_.erase(entry);
+        }
+    }
+
+    const std::unordered_set<gc_handle_entry*>& pinned() {
+        return pinned_;
+    }
+
+    template<typename F>
+    void for_each_marked(F&& visit) {
+        for (auto chunk : chunks_)
+        {
+            for (auto entry : chunk->objs)
+            {
+                if (entry->flags & MOVABLE_MARKED) { visit(entry); }
+            }
+        }
+    }
+
+    // Drops marks without freeing anything, used when a collection cycle ends without a sweep.
+    void clear_marks() {
+        for (auto chunk : chunks_)
+        {
+            for (auto entry : chunk->objs)
+            {
+                entry->flags = 0;
+            }
+        }
+    }
+
+    // Frees unmarked objects. With `compact` live objects are slid towards the start of their chunk,
+    // except pinned ones. Returns the number of freed bytes.
+    size_t sweep(bool compact) {
+        size_t freed = 0;
+        for (auto itr = chunks_.begin(); itr != chunks_.end();)
+        {
+            movable_chunk* chunk = *itr;
+            size_t old_top = chunk->top;
+
+            std::erase_if(chunk->objs, [this, &freed](gc_handle_entry* entry) -> bool {
+                if (entry->flags & MOVABLE_MARKED) { return false; }
+                freed += entry->size;
+                drop_entry(entry);
+                return true;
+            });
+
+            char* cursor = chunk->base;
+            for (auto entry : chunk->objs)
+            {
+                char* addr = static_cast<char*>(entry->addr);
+                size_t aligned_size = arena_round_up(entry->size > 0 ? entry->size : 1, MOVABLE_ALIGN);
+
+                if (compact && !(entry->flags & MOVABLE_PINNED) && entry->pin_cnt == 0 && addr != cursor)
+                {
+                    memmove(cursor, addr, entry->size);
+                    entry->addr = cursor;
+                    addr = cursor;
+                }
+                cursor = addr + aligned_size;
+                entry->flags = 0;
+            }
+            chunk->top = cursor - chunk->base;
+
+            if (chunk->objs.empty() && chunk != cur_)
+            {
+                unmap_chunk(chunk);
+                itr = chunks_.erase(itr);
+                continue;
+            }
+
+            // Pages above the new top go back to the kernel, only the partial page under it is cleared.
+            char* new_top = chunk->base + chunk->top;
+            char* page_end = reinterpret_cast<char*>(arena_round_up(reinterpret_cast<uintptr_t>(new_top), arena_page_size()));
+            char* old_end = reinterpret_cast<char*>(arena_round_up(reinterpret_cast<uintptr_t>(chunk->base + old_top), arena_page_size()));
+            memset(new_top, 0, std::min(page_end, chunk->base + old_top) - new_top);
+            arena_decommit(new_top, old_end);
+            ++itr;
+        }
+        return freed;
+    }
+
+    bool empty() {
+        return cnt_ == 0;
+    }
+
+    // Memory mapped from now on, and pages of existing chunks faulted from now on, come from `node`.
+    void set_node(int node) {
+        if (node == node_) { return; }
+        node_ = node;
+        for (auto chunk : chunks_)
+        {
+            numa_bind(chunk->base, chunk->cap, node_);
+        }
+        numa_bind(table_, MOVABLE_HANDLES_MAX * sizeof(gc_handle_entry), node_);
+    }
+
+    // Chunks mapped from now on are huge page aligned and advised. Empty chunks cached with the other
+    // setting are dropped. The handle table stays on regular pages, it is reserved at full size but used sparsely.
+    void set_huge_pages(bool huge_pages) {
+        if (huge_pages == huge_pages_) { return; }
+        huge_pages_ = huge_pages;
+        if (cnt_ != 0) { return; }
+
+        for (auto chunk : chunks_)
+        {
+            unmap_chunk(chunk);
+        }
+        chunks_.clear();
+        cur_ = NULL;
+    }
+
+    size_t huge_bytes() {
+        return huge_bytes_;
+    }
+
+    size_t count() {
+        return cnt_;
+    }
+
+    // Bytes below a chunk's top that no object holds are holes left by freed objects until a compaction.
+    void census(gc_census& census) {
+        size_t page = arena_page_size();
+        for (auto chunk : chunks_)
+        {
+            census.arena_bytes += chunk->cap;
+            census.arena_free_bytes += chunk->cap - chunk->top;
+
+            size_t live = 0;
+            size_t first = 0;
+            for (size_t off = 0; off < chunk->top; off += page)
+            {
+                size_t used = 0;
+                for (size_t i = first; i < chunk->objs.size(); i++)
+                {
+                    size_t begin = static_cast<char*>(chunk->objs[i]->addr) - chunk->base;
+                    size_t end = begin + chunk->objs[i]->size;
+                    if (begin >= off + page) { break; }
+                    if (end <= off)
+                    {
+                        first = i + 1;
+                        continue;
+                    }
+                    used += std::min(end, off + page) - std::max(begin, off);
+                }
+                census_add_page(census, used, page);
+            }
+            for (auto entry : chunk->objs)
+            {
+                live += entry->size;
+            }
+            census.movable_objects += chunk->objs.size();
+            census.movable_bytes += live;
+            census.arena_fragmented_bytes += chunk->top - live;
+        }
+    }
+
+    ~movable_space() {
+        for (auto chunk : chunks_)
+        {
+            unmap_chunk(chunk);
+        }
+        if (table_ != NULL)
+        {
+            arena_unmap(table_, MOVABLE_HANDLES_MAX * sizeof(gc_handle_entry));
+        }
+    }
+
+private:
+    gc_handle_entry* new_entry() {
+        if (!free_entries_.empty())
+        {
+            gc_handle_entry* entry = free_entries_.back();
+            free_entries_.pop_back();
+            return entry;
+        }
+        if (table_used_ == MOVABLE_HANDLES_MAX) { return NULL; }
+        return &table_[table_used_++];
+    }
+
+    void drop_entry(gc_handle_entry* entry) {
+        entry->addr = NULL;
+        entry->pin_cnt = 0;
+        free_entries_.push_back(entry);
+        --cnt_;
+    }
+
+    movable_chunk* new_chunk(size_t min_size) {
+        size_t cap = arena_round_up(std::max<size_t>(min_size, MOVABLE_CHUNK_SIZE), arena_page_size());
+        bool huge = false;
+        char* base = static_cast<char*>(huge_pages_ ? arena_map_huge(cap, node_, huge) : arena_map(cap, node_));
+        if (base == NULL) { return NULL; }
+        if (huge) { huge_bytes_ += cap; }
+
+        movable_chunk* chunk = new movable_chunk{base, cap, 0, {}, huge};
+        auto pos = std::upper_bound(chunks_.begin(), chunks_.end(), chunk, [](auto lhs, auto rhs) {
+            return lhs->base < rhs->base;
+        });
+        chunks_.insert(pos, chunk);
+        return chunk;
+    }
+
+    void unmap_chunk(movable_chunk* chunk) {
+        if (chunk->huge) { huge_bytes_ -= chunk->cap; }
+        arena_unmap(chunk->base, chunk->cap);
+        delete chunk;
+    }
+
+    movable_chunk* find_chunk(void* ptr) {
+        char* p = static_cast<char*>(ptr);
+        auto itr = std::upper_bound(chunks_.begin(), chunks_.end(), p, [](char* p, auto chunk) {
+            return p < chunk->base;
+        });
+        if (itr == chunks_.begin()) { return NULL; }
+        --itr;
+        return p < (*itr)->base + (*itr)->cap ? *itr : NULL;
+    }
+
+    gc_handle_entry* table_ = NULL;
+    size_t table_used_ = 0;
+    std::vector<gc_handle_entry*> free_entries_;
+
+    std::vector<movable_chunk*> chunks_;
+    movable_chunk* cur_ = NULL;
+    std::unordered_set<gc_handle_entry*> pinned_;
+    size_t cnt_ = 0;
+    int node_ = -1;
+    bool huge_pages_ = false;
+    size_t huge_bytes_ = 0;
+};
+
+#endif //GC_PROJECT_MOVABLE_SPACE_H
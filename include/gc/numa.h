@@ -0,0 +1,109 @@
+#ifndef GC_PROJECT_NUMA_H
+#define GC_PROJECT_NUMA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <algorithm>
+
+#include "gc/log.h"
+
+// Node masks are a single word, larger machines are treated as having NUMA_NODES_MAX nodes.
+#define NUMA_NODES_MAX 64
+
+// Node numbers are -1 when placement does not matter: on single-node machines every helper is a no-op.
+// The syscalls are made directly, so there is no dependency on libnuma.
+
+// Calls visit(i) for every number of a sysfs list like "0-3,8-11".
+template<typename F>
+inline bool numa_parse_list(const char* path, F&& visit) {
+    FILE* in = fopen(path, "r");
+    if (in == NULL) { return false; }
+
+    char buf[4096];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, in);
+    fclose(in);
+    buf[len] = '\0';
+
+    char* cur = buf;
+    while (true)
+    {
+        char* end;
+        long first = strtol(cur, &end, 10);
+        if (end == cur) { break; }
+        long last = first;
+        if (*end == '-')
+        {
+            cur = end + 1;
+            last = strtol(cur, &end, 10);
+        }
+        for (long i = first; i <= last; i++)
+        {
+            visit(i);
+        }
+        if (*end != ',') { break; }
+        cur = end + 1;
+    }
+    return true;
+}
+
+inline int numa_nodes_cnt() {
+    static const int cnt = []() {
+        long max_node = 0;
+        numa_parse_list("/sys/devices/system/node/online", [&max_node](long node) {
+            max_node = std::max(max_node, node);
+        });
+        return static_cast<int>(std::min<long>(max_node + 1, NUMA_NODES_MAX));
+    }();
+    return cnt;
+}
+
+// Node the calling thread's memory should come from: the node of its memory policy if it is bound to
+// exactly one (numactl --membind, --preferred), otherwise the node of the CPU it runs on.
+inline int numa_current_node() {
+    if (numa_nodes_cnt() == 1) { return -1; }
+
+    int mode;
+    unsigned long mask = 0;
+    if (syscall(SYS_get_mempolicy, &mode, &mask, NUMA_NODES_MAX + 1, NULL, 0) == 0 &&
+        (mode == MPOL_BIND || mode == MPOL_PREFERRED) && mask != 0 && (mask & (mask - 1)) == 0)
+    {
+        return __builtin_ctzl(mask);
+    }
+
+    unsigned cpu;
+    unsigned node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) { return -1; }
+    return node < NUMA_NODES_MAX ? static_cast<int>(node) : -1;
+}
+
+// Pages of [mem, mem + size) faulted from now on are taken from `node` while it has free memory.
+inline void numa_bind(void* mem, size_t size, int node) {
+    if (node < 0 || mem == NULL) { return; }
+
+    unsigned long mask = 1ul << node;
+    if (syscall(SYS_mbind, mem, size, MPOL_PREFERRED, &mask, NUMA_NODES_MAX + 1, 0) != 0)
+    {
+        LOG_DEBUG("Failed to bind %p to node %d", mem, node);
+    }
+}
+
+inline bool numa_node_cpus(int node, cpu_set_t& cpus) {
+    CPU_ZERO(&cpus);
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    bool any = false;
+    numa_parse_list(path, [&cpus, &any](long cpu) {
+        if (cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &cpus);
+            any = true;
+        }
+    });
+    return any;
+}
+
+#endif //GC_PROJECT_NUMA_H
@@ -0,0 +1,162 @@
+#ifndef GC_PROJECT_POLICY_H
+#define GC_PROJECT_POLICY_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+
+// Strategies basic_gc is built from. A configuration names one policy of each kind, and the library is
+// compiled for the configuration in GC_CONFIG, so the policies are inlined into the collector and choosing
+// between them costs nothing at run time.
+
+#define POISON_ALLOC_BYTE 0xcd
+#define POISON_FREE_BYTE 0xdd
+
+// Allocator policies hand out the blocks of the general heap. Regions and the movable space keep their arenas.
+struct malloc_allocator
+{
+    static void* allocate(size_t size) {
+        return malloc(size);
+    }
+
+    static void* allocate_zeroed(size_t size) {
+        return calloc(1, size);
+    }
+
+    static void* reallocate(void* addr, size_t, size_t size) {
+        return realloc(addr, size);
+    }
+
+    static void release(void* addr, size_t) {
+        free(addr);
+    }
+};
+
+// Fills new blocks with POISON_ALLOC_BYTE and released ones with POISON_FREE_BYTE, and moves every block it
+// resizes. Reads of uninitialized memory and of blocks freed under a missing root show up as the patterns.
+struct poisoning_allocator
+{
+    static void* allocate(size_t size) {
+        void* addr = malloc(size);
+        if (addr != NULL) { memset(addr, POISON_ALLOC_BYTE, size); }
+        return addr;
+    }
+
+    static void* allocate_zeroed(size_t size) {
+        return calloc(1, size);
+    }
+
+    static void* reallocate(void* addr, size_t old_size, size_t size) {
+        void* mem = allocate(size);
+        if (mem == NULL) { return NULL; }
+        memcpy(mem, addr, old_size < size ? old_size : size);
+        release(addr, old_size);
+        return mem;
+    }
+
+    static void release(void* addr, size_t size) {
+        memset(addr, POISON_FREE_BYTE, size);
+        free(addr);
+    }
+};
+
+// Index policies map the address of a block to its alloc_info. `reserve` blocks fit in a new index without
+// a rehash, which would otherwise stall an allocation of a growing heap.
+template<size_t Reserve>
+struct hash_index
+{
+    template<typename Key, typename Value>
+    using map = std::unordered_map<Key, Value>;
+
+    static constexpr size_t reserve = Reserve;
+};
+
+// Scan policies give the step between the candidate pointers read from scanned memory. Byte steps also find
+// pointers stored at unaligned offsets, as in packed structures. Word steps read aligned slots only, and
+// look up eight times fewer candidates.
+struct byte_scan
+{
+    static constexpr size_t step = 1;
+};
+
+struct word_scan
+{
+    static constexpr size_t step = sizeof(void*);
+};
+
+// Trigger policies move the threshold of implicit collections after one ran. `allocated` is what the heap
+// has allocated since it was created, minus explicit frees, `live` what survived.
+struct doubling_trigger
+{
+    static constexpr uint64_t initial = 1024;
+
+    static uint64_t next(uint64_t threshold, uint64_t, uint64_t) {
+        return UINT64_MAX / 2 > threshold ? threshold * 2 : threshold;
+    }
+};
+
+// Collects once the heap allocated as much again as survived, at least `Min` bytes. Every collection sweeps
+// about as much garbage as there is live data, instead of ever more as the program runs.
+template<uint64_t Min>
+struct proportional_trigger
+{
+    static constexpr uint64_t initial = Min;
+
+    static uint64_t next(uint64_t, uint64_t allocated, uint64_t live) {
+        return allocated + (live > Min ? live : Min);
+    }
+};
+
+// Collects every `Bytes` allocated bytes.
+template<uint64_t Bytes>
+struct interval_trigger
+{
+    static constexpr uint64_t initial = Bytes;
+
+    static uint64_t next(uint64_t, uint64_t allocated, uint64_t) {
+        return allocated + Bytes;
+    }
+};
+
+// Prebuilt configurations, one library each, see CMakeLists.txt.
+struct default_config
+{
+    static constexpr const char* name = "default";
+    using allocator = malloc_allocator;
+    using index = hash_index<0>;
+    using scan = byte_scan;
+    using trigger = doubling_trigger;
+};
+
+// Batch workloads: collections get rarer as the heap grows and scanning reads aligned words only.
+struct throughput_config
+{
+    static constexpr const char* name = "throughput";
+    using allocator = malloc_allocator;
+    using index = hash_index<0>;
+    using scan = word_scan;
+    using trigger = doubling_trigger;
+};
+
+// Interactive workloads: pauses follow the live size and small heaps never rehash their index.
+struct low_latency_config
+{
+    static constexpr const char* name = "low-latency";
+    using allocator = malloc_allocator;
+    using index = hash_index<1 << 14>;
+    using scan = word_scan;
+    using trigger = proportional_trigger<1 << 20>;
+};
+
+// Hunting missing roots: frequent collections, poisoned memory and the most conservative scan.
+struct debug_config
+{
+    static constexpr const char* name = "debug";
+    using allocator = poisoning_allocator;
+    using index = hash_index<0>;
+    using scan = byte_scan;
+    using trigger = interval_trigger<64 * 1024>;
+};
+
+#endif //GC_PROJECT_POLICY_H
@@ -0,0 +1,127 @@
+#ifndef GC_PROJECT_PRESSURE_H
+#define GC_PROJECT_PRESSURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#include <string>
+
+#include "gc/log.h"
+
+#define PRESSURE_PERIOD_MS 100
+#define PRESSURE_COOLDOWN_MS 500
+#define PRESSURE_SOME_AVG10 10.0        // % of the last 10 s some task stalled on memory
+#define PRESSURE_CGROUP_PERCENT 90      // memory.current of memory.max
+// Trigger of a real PSI file: 150 ms of stall within a 2 s window. Unprivileged processes may only
+// use windows that are multiples of 2 s.
+#define PRESSURE_TRIGGER "some 150000 2000000"
+
+// Memory pressure from a PSI file. On procfs the kernel trigger wakes a poll() with POLLPRI. Other files,
+// like stand-ins written by tests, and kernels that refuse the trigger are polled for the "some avg10" value.
+class pressure_source {
+public:
+    explicit pressure_source(const std::string& path) : path_(path) {
+        fd_ = open(path_.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd_ < 0) { return; }
+
+        struct statfs fs;
+        if (fstatfs(fd_, &fs) == 0 && fs.f_type == PROC_SUPER_MAGIC &&
+            write(fd_, PRESSURE_TRIGGER, strlen(PRESSURE_TRIGGER) + 1) > 0)
+        {
+            triggered_ = true;
+            return;
+        }
+        LOG_DEBUG("No PSI trigger on %s, polling averages", path_.c_str());
+        close(fd_);
+        fd_ = -1;
+    }
+
+    pressure_source(const pressure_source&) = delete;
+    pressure_source& operator=(const pressure_source&) = delete;
+
+    bool triggered() {
+        return triggered_;
+    }
+
+    // Waits up to `timeout_ms` for the trigger. Returns true when it fired.
+    bool wait(int timeout_ms) {
+        struct pollfd pfd = {fd_, POLLPRI, 0};
+        if (poll(&pfd, 1, timeout_ms) <= 0) { return false; }
+        if (pfd.revents & (POLLERR | POLLNVAL))
+        {
+            LOG_WARNING("PSI trigger on %s was dropped, polling averages", path_.c_str());
+            triggered_ = false;
+            return false;
+        }
+        return (pfd.revents & POLLPRI) != 0;
+    }
+
+    bool above_average() {
+        FILE* in = fopen(path_.c_str(), "r");
+        if (in == NULL) { return false; }
+
+        double avg10 = 0;
+        bool found = fscanf(in, "some avg10=%lf", &avg10) == 1;
+        fclose(in);
+        return found && avg10 >= PRESSURE_SOME_AVG10;
+    }
+
+    ~pressure_source() {
+        if (fd_ >= 0) { close(fd_); }
+    }
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    bool triggered_ = false;
+};
+
+// Directory of the process's cgroup v2, empty when there is none.
+inline std::string pressure_cgroup_dir() {
+    FILE* in = fopen("/proc/self/cgroup", "r");
+    if (in == NULL) { return ""; }
+
+    std::string dir;
+    char line[4096];
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        if (strncmp(line, "0::", 3) != 0) { continue; }
+        line[strcspn(line, "\n")] = '\0';
+        dir = std::string("/sys/fs/cgroup") + (line + 3);
+        break;
+    }
+    fclose(in);
+    return dir;
+}
+
+// False for "max" and for missing files.
+inline bool pressure_cgroup_value(const std::string& dir, const char* name, uint64_t& value) {
+    std::string path = dir + "/" + name;
+    FILE* in = fopen(path.c_str(), "r");
+    if (in == NULL) { return false; }
+
+    unsigned long long read_value;
+    bool ok = fscanf(in, "%llu", &read_value) == 1;
+    fclose(in);
+    value = read_value;
+    return ok;
+}
+
+inline bool pressure_cgroup_near_limit(const std::string& dir) {
+    if (dir.empty()) { return false; }
+
+    uint64_t max;
+    uint64_t current;
+    if (!pressure_cgroup_value(dir, "memory.max", max) || !pressure_cgroup_value(dir, "memory.current", current))
+    {
+        return false;
+    }
+    return current >= max / 100 * PRESSURE_CGROUP_PERCENT;
+}
+
+#endif //GC_PROJECT_PRESSURE_H
@@ -0,0 +1,49 @@
+#ifndef GC_PROJECT_PROFILER_H
+#define GC_PROJECT_PROFILER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#define PROFILER_MAX_DEPTH 32
+#define PROFILER_DEFAULT_SAMPLE_BYTES (512 * 1024)
+
+struct alloc_site
+{
+    uint64_t hash;
+    int depth;
+    void* frames[PROFILER_MAX_DEPTH];
+    std::atomic<uint64_t> total_cnt;
+    std::atomic<uint64_t> total_bytes;
+    std::atomic<uint64_t> live_cnt;
+    std::atomic<uint64_t> live_bytes;
+    alloc_site* next;
+};
+
+// Average number of allocated bytes between two samples, 0 when the profiler is off.
+extern std::atomic<size_t> profiler_sample_bytes;
+
+// Per-heap sampling state, only touched by the thread that owns the heap.
+struct profiler_sampler
+{
+    int64_t bytes_until_sample = 0;
+    uint64_t rnd_state = 0;
+
+    // Returns the site of the caller's stack if this allocation has to be sampled.
+    alloc_site* sample(size_t size) {
+        size_t interval = profiler_sample_bytes.load(std::memory_order_relaxed);
+        if (interval == 0) [[likely]] { return NULL; }
+
+        bytes_until_sample -= static_cast<int64_t>(size);
+        if (bytes_until_sample > 0) [[likely]] { return NULL; }
+        return take_sample(size, interval);
+    }
+
+    alloc_site* take_sample(size_t size, size_t interval);
+};
+
+void profiler_release(alloc_site* site, size_t size);
+void profiler_resize(alloc_site* site, size_t old_size, size_t new_size);
+void profiler_report();
+
+#endif //GC_PROJECT_PROFILER_H
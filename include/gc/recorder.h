@@ -0,0 +1,50 @@
+#ifndef GC_PROJECT_RECORDER_H
+#define GC_PROJECT_RECORDER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+
+#define RECORD_MAGIC "GCREC001"
+#define RECORD_MAGIC_LEN 8
+
+enum class RECORD_KIND : uint8_t {
+    CREATE,         // size: gc_create_ex flags
+    STOP,
+    MALLOC,         // obj: result, slot: destination variable, size: requested size
+    CALLOC,
+    REALLOC,        // obj: result, slot: destination variable, which held the old block
+    FREE,           // obj: freed block
+    MARK_ROOT,      // obj: root variable
+    UNMARK_ROOT,
+    COLLECT,        // size: THREAD_LOCAL or GLOBAL
+};
+
+// On-disk record, written in native byte order after the magic. Threads are numbered in order of their first event.
+struct record_entry
+{
+    uint64_t ts_ns;
+    uint64_t obj;
+    uint64_t slot;
+    uint64_t size;
+    uint32_t tid;
+    RECORD_KIND kind;
+    uint8_t pad[3];
+};
+
+static_assert(sizeof(record_entry) == 40, "record_entry is a file format");
+
+extern std::atomic<bool> record_on;
+
+void record_event(RECORD_KIND kind, pthread_t tid, const void* obj, const void* slot, uint64_t size);
+
+#define RECORD(kind, tid, obj, slot, size)                                                                      \
+    do                                                                                                          \
+    {                                                                                                           \
+        if (record_on.load(std::memory_order_relaxed)) [[unlikely]]                                             \
+        {                                                                                                       \
+            record_event(RECORD_KIND::kind, (tid), (obj), (slot), (uint64_t)(size));                            \
+        }                                                                                                       \
+    } while (0);                                                                                                \
+
+#endif //GC_PROJECT_RECORDER_H
@@ -0,0 +1,177 @@
+#ifndef GC_PROJECT_REGION_H
+#define GC_PROJECT_REGION_H
+
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "gc/arena.h"
+#include "gc/census.h"
+
+#define REGION_CHUNK_SIZE (256 * 1024)
+#define REGION_ALIGN 16
+
+// Header in front of every region object, needed to copy the object out on promotion.
+struct region_header
+{
+    size_t size;
+    size_t pad;
+};
+
+struct region_chunk
+{
+    char* base;
+    size_t cap;
+    size_t top;
+    bool huge;      // mapped with huge page advice
+};
+
+// Bump arena of a GC_REGION_BEGIN / GC_REGION_END scope. Objects are never freed one by one,
+// the whole arena is released at the end of the scope. Memory above a chunk's top reads as zero.
+class region_arena {
+public:
+    explicit region_arena(int node = -1, bool huge_pages = false) : node_(node), huge_pages_(huge_pages) {}
+    region_arena(const region_arena&) = delete;
+    region_arena& operator=(const region_arena&) = delete;
+
+    void* allocate(size_t size) {
+        size_t aligned_size = span(size);
+        if (chunks_.empty() || chunks_.back().cap - chunks_.back().top < aligned_size)
+        {
+            if (!new_chunk(aligned_size)) { return NULL; }
+        }
+
+        region_chunk& chunk = chunks_.back();
+        region_header* header = reinterpret_cast<region_header*>(chunk.base + chunk.top);
+        header->size = size;
+        chunk.top += aligned_size;
+        bytes_ += size;
+        return header + 1;
+    }
+
+    // True if `ptr` is the start of an object of the arena. size_of reads the header in front of it, so
+    // interior pointers are rejected. The arena keeps no index, the headers of the chunk are walked.
+    bool contains(void* ptr) {
+        char* p = static_cast<char*>(ptr);
+        for (const auto& chunk : chunks_)
+        {
+            if (p < chunk.base || p >= chunk.base + chunk.top) { continue; }
+
+            for (size_t offset = 0; offset < chunk.top; )
+            {
+                region_header* header = reinterpret_cast<region_header*>(chunk.base + offset);
+                if (reinterpret_cast<char*>(header + 1) >= p) { return reinterpret_cast<char*>(header + 1) == p; }
+                offset += span(header->size);
+            }
+            return false;
+        }
+        return false;
+    }
+
+    size_t size_of(void* ptr) {
+        return (static_cast<region_header*>(ptr) - 1)->size;
+    }
+
+    size_t bytes() {
+        return bytes_;
+    }
+
+    // Chunks mapped from now on are huge page aligned and advised. Empty chunks cached with the other
+    // setting are dropped.
+    void set_huge_pages(bool huge_pages) {
+        if (huge_pages == huge_pages_) { return; }
+        huge_pages_ = huge_pages;
+        bool used = std::any_of(chunks_.begin(), chunks_.end(), [](const region_chunk& chunk) { return chunk.top != 0; });
+        if (used) { return; }
+
+        for (auto& chunk : chunks_)
+        {
+            unmap_chunk(chunk);
+        }
+        chunks_.clear();
+    }
+
+    size_t huge_bytes() {
+        return huge_bytes_;
+    }
+
+    // Chunks mapped from now on, and pages of existing ones faulted from now on, come from `node`.
+    void set_node(int node) {
+        if (node == node_) { return; }
+        node_ = node;
+        for (auto& chunk : chunks_)
+        {
+            numa_bind(chunk.base, chunk.cap, node_);
+        }
+    }
+
+    const std::vector<region_chunk>& chunks() {
+        return chunks_;
+    }
+
+    // Region objects are allocated back to back, so every page below a chunk's top is full but the last.
+    void census(gc_census& census) {
+        size_t page = arena_page_size();
+        for (const auto& chunk : chunks_)
+        {
+            census.arena_bytes += chunk.cap;
+            census.arena_free_bytes += chunk.cap - chunk.top;
+            census.arena_pages[GC_CENSUS_OCCUPANCY - 1] += chunk.top / page;
+            if (chunk.top % page != 0) { census_add_page(census, chunk.top % page, page); }
+        }
+    }
+
+    // Drops all objects. The first chunk is kept for the next region, its pages are given back to the kernel.
+    void reset() {
+        for (size_t i = 1; i < chunks_.size(); i++)
+        {
+            unmap_chunk(chunks_[i]);
+        }
+        if (!chunks_.empty())
+        {
+            region_chunk& first = chunks_.front();
+            char* used_end = reinterpret_cast<char*>(arena_round_up(reinterpret_cast<uintptr_t>(first.base + first.top), arena_page_size()));
+            arena_decommit(first.base, used_end);
+            first.top = 0;
+            chunks_.resize(1);
+        }
+        bytes_ = 0;
+    }
+
+    ~region_arena() {
+        for (auto& chunk : chunks_)
+        {
+            unmap_chunk(chunk);
+        }
+    }
+
+private:
+    // Bytes an object of `size` takes in a chunk, header included.
+    static size_t span(size_t size) {
+        return sizeof(region_header) + arena_round_up(size > 0 ? size : 1, REGION_ALIGN);
+    }
+
+    bool new_chunk(size_t min_size) {
+        size_t cap = arena_round_up(std::max<size_t>(min_size, REGION_CHUNK_SIZE), arena_page_size());
+        bool huge = false;
+        char* base = static_cast<char*>(huge_pages_ ? arena_map_huge(cap, node_, huge) : arena_map(cap, node_));
+        if (base == NULL) { return false; }
+        if (huge) { huge_bytes_ += cap; }
+
+        chunks_.push_back(region_chunk{base, cap, 0, huge});
+        return true;
+    }
+
+    void unmap_chunk(const region_chunk& chunk) {
+        if (chunk.huge) { huge_bytes_ -= chunk.cap; }
+        arena_unmap(chunk.base, chunk.cap);
+    }
+
+    std::vector<region_chunk> chunks_;
+    size_t bytes_ = 0;
+    int node_ = -1;
+    bool huge_pages_ = false;
+    size_t huge_bytes_ = 0;
+};
+
+#endif //GC_PROJECT_REGION_H
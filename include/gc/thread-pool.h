@@ -1,5 +1,6 @@
 #include <iostream>
-#include <queue>
+#include <deque>
+#include <algorithm>
 #include <thread>
 #include <chrono>
 #include <mutex>
@@ -11,6 +12,8 @@
 #include <chrono>
 
 #include "gc/log.h"
+#include "gc/numa.h"
+#include "gc/latency.h"
 
 class thread_pool {
 public:
@@ -20,36 +23,49 @@ public:
         threads_.reserve(n_threads);
         for (size_t i = 0; i < n_threads; i++)
         {
-            threads_.emplace_back(&thread_pool::run, this);
+            add_thread();
         }
     }
 
+    // Tasks of add_task and add_task_on are waited for by the caller, so their time in the queue
+    // is added to the caller's latency scope.
     template <typename Func, typename ...Args>
     int64_t add_task(const Func& task_func, Args&&... args) {
         std::unique_lock add_lock(add_task_mtx_);
-        add_task_cv_.wait(add_lock, [this](){
-            return !block_tpool_.load();
-        });
+        {
+            latency_part blocked(GC_LATENCY_BLOCKED);
+            add_task_cv_.wait(add_lock, [this](){
+                return !block_tpool_.load();
+            });
+        }
 
         // while (block_tpool_.load()) {}
 
-        int64_t task_idx = last_idx_.fetch_add(1);
-        
-        std::lock_guard q_lock(q_mtx_);
-        queue_.emplace(std::async(std::launch::deferred, task_func, args...), task_idx);
-        q_cv_.notify_one();
-        return task_idx;
+        return push(-1, std::async(std::launch::deferred, task_func, args...), latency_current);
     }
 
     template <typename Func, typename ...Args>
     int64_t add_priority_task(const Func& task_func, Args&&... args) {
-        int64_t task_idx = last_idx_.fetch_add(1);
-        
         LOG_DEBUG("Tpool q_mutex = %d", (int)check_q_mutex());
-        std::lock_guard q_lock(q_mtx_);
-        queue_.emplace(std::async(std::launch::deferred, task_func, args...), task_idx);
-        q_cv_.notify_one();
-        return task_idx;
+        return push(-1, std::async(std::launch::deferred, task_func, args...), NULL);
+    }
+
+    // The *_on variants run the task on a worker of NUMA node `node`, or on any worker when the node has none.
+    template <typename Func, typename ...Args>
+    int64_t add_task_on(int node, const Func& task_func, Args&&... args) {
+        std::unique_lock add_lock(add_task_mtx_);
+        {
+            latency_part blocked(GC_LATENCY_BLOCKED);
+            add_task_cv_.wait(add_lock, [this](){
+                return !block_tpool_.load();
+            });
+        }
+        return push(node, std::async(std::launch::deferred, task_func, args...), latency_current);
+    }
+
+    template <typename Func, typename ...Args>
+    int64_t add_priority_task_on(int node, const Func& task_func, Args&&... args) {
+        return push(node, std::async(std::launch::deferred, task_func, args...), NULL);
     }
 
     void wait(int64_t task_id) {
@@ -84,9 +100,16 @@ public:
         add_task_cv_.notify_all();
     }
 
+    // On NUMA machines workers are spread over the nodes round-robin and kept on their node's CPUs.
     void add_thread() {
         std::lock_guard thread_lock(threads_mtx_);
-        threads_.emplace_back(&thread_pool::run, this);
+        int node = -1;
+        if (numa_nodes_cnt() > 1)
+        {
+            node = static_cast<int>(threads_.size() % numa_nodes_cnt());
+            node_workers_[node].fetch_add(1);
+        }
+        threads_.emplace_back(&thread_pool::run, this, node);
     }
 
     void remove_thread() {
@@ -108,12 +131,57 @@ public:
     }
 
 private:
-    void run() {
+    struct task
+    {
+        std::future<void> func;
+        int64_t idx;
+        int node;
+        latency_scope* scope;   // of the waiting caller, NULL if latency is off
+        uint64_t pushed_ns;
+    };
+
+    int64_t push(int node, std::future<void>&& func, latency_scope* scope) {
+        if (node >= 0 && (node >= NUMA_NODES_MAX || node_workers_[node].load() == 0))
+        {
+            node = -1;
+        }
+
+        int64_t task_idx = last_idx_.fetch_add(1);
+        std::lock_guard q_lock(q_mtx_);
+        queue_.push_back(task{std::move(func), task_idx, node, scope, scope != NULL ? latency_now() : 0});
+        // A single woken worker may be on another node
+        if (node >= 0)
+        {
+            q_cv_.notify_all();
+        } else
+        {
+            q_cv_.notify_one();
+        }
+        return task_idx;
+    }
+
+    // Called with q_mtx_ held.
+    std::deque<task>::iterator find_task(int node) {
+        return std::find_if(queue_.begin(), queue_.end(), [node](const task& t) {
+            return t.node < 0 || t.node == node;
+        });
+    }
+
+    void run(int node) {
+        if (node >= 0)
+        {
+            cpu_set_t cpus;
+            if (numa_node_cpus(node, cpus))
+            {
+                sched_setaffinity(0, sizeof(cpus), &cpus);
+            }
+        }
+
         while (!quite_)
         {
             std::unique_lock q_lock(q_mtx_);
-            q_cv_.wait(q_lock, [this]() -> bool {
-                return !queue_.empty() || quite_;
+            q_cv_.wait(q_lock, [this, node]() -> bool {
+                return find_task(node) != queue_.end() || quite_;
             });
 
             if (block_tpool_.load())
@@ -122,23 +190,31 @@ private:
             }
             
 
-            if (!queue_.empty())
+            auto itr = find_task(node);
+            if (itr != queue_.end())
             {
-                auto elem = std::move(queue_.front());
-                queue_.pop();
+                task elem = std::move(*itr);
+                queue_.erase(itr);
                 q_lock.unlock();
 
-                elem.first.get();
+                // The worker works for the caller, so collections it runs are the caller's too
+                if (elem.scope != NULL)
+                {
+                    elem.scope->parts[GC_LATENCY_QUEUED] += latency_now() - elem.pushed_ns;
+                }
+                latency_current = elem.scope;
+                elem.func.get();
+                latency_current = NULL;
 
                 std::lock_guard ct_lock(ct_mtx_);
-                completed_tasks_idx_.insert(elem.second);
+                completed_tasks_idx_.insert(elem.idx);
 
                 ct_cv_.notify_all();
             }   
         }
     }
 
-    std::queue<std::pair<std::future<void>, int64_t>> queue_;
+    std::deque<task> queue_;
     std::mutex q_mtx_;
     std::condition_variable q_cv_;
 
@@ -148,6 +224,7 @@ private:
 
     std::vector<std::thread> threads_;
     std::mutex threads_mtx_;
+    std::atomic<int> node_workers_[NUMA_NODES_MAX] = {};
 
     std::atomic<bool> quite_ = false;
     std::atomic<int64_t> last_idx_ = 0;
@@ -0,0 +1,52 @@
+#ifndef GC_PROJECT_TRACE_H
+#define GC_PROJECT_TRACE_H
+
+#include <stdint.h>
+#include <atomic>
+
+enum class TRACE_LEVEL {
+    OFF,
+    PHASES,
+    OBJECTS,
+};
+
+enum class TRACE_EVENT : uint8_t {
+    COLLECT,
+    MARK,
+    SWEEP,
+    GLOBAL_RUN,
+    BACKGROUND_COLLECT,
+    MALLOC,
+    FREE,
+    SWEEP_OBJECT,
+    SNAPSHOT_FORK,
+};
+
+// Phase letters follow the Chrome trace-event format: 'B' begin, 'E' end, 'i' instant.
+struct trace_record
+{
+    uint64_t ts_ns;
+    uint64_t arg;
+    uint32_t tid;
+    TRACE_EVENT event;
+    char phase;
+};
+
+extern std::atomic<int> trace_lvl;
+
+void trace_emit(TRACE_EVENT event, char phase, uint64_t arg);
+
+#define TRACE(level, event, phase, arg)                                                                         \
+    do                                                                                                          \
+    {                                                                                                           \
+        if (static_cast<int>(level) <= trace_lvl.load(std::memory_order_relaxed)) [[unlikely]]                  \
+        {                                                                                                       \
+            trace_emit((event), (phase), (uint64_t)(arg));                                                      \
+        }                                                                                                       \
+    } while (0);                                                                                                \
+
+#define TRACE_BEGIN(event, arg) TRACE(TRACE_LEVEL::PHASES, TRACE_EVENT::event, 'B', arg)
+#define TRACE_END(event, arg) TRACE(TRACE_LEVEL::PHASES, TRACE_EVENT::event, 'E', arg)
+#define TRACE_OBJECT(event, arg) TRACE(TRACE_LEVEL::OBJECTS, TRACE_EVENT::event, 'i', arg)
+
+#endif //GC_PROJECT_TRACE_H
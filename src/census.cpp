@@ -0,0 +1,195 @@
+#include "gc/gc.h"
+#include "gc/log.h"
+#include "gc/census.h"
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <malloc.h>
+#include <unistd.h>
+
+void census_merge(gc_census& total, const gc_census& part) {
+    total.collections += part.collections;
+    total.objects += part.objects;
+    total.bytes += part.bytes;
+    for (size_t i = 0; i < GC_CENSUS_CLASSES; i++)
+    {
+        total.class_objects[i] += part.class_objects[i];
+        total.class_bytes[i] += part.class_bytes[i];
+    }
+    total.large_objects += part.large_objects;
+    total.large_bytes += part.large_bytes;
+    total.movable_objects += part.movable_objects;
+    total.movable_bytes += part.movable_bytes;
+    total.arena_bytes += part.arena_bytes;
+    total.arena_free_bytes += part.arena_free_bytes;
+    total.arena_fragmented_bytes += part.arena_fragmented_bytes;
+    for (size_t i = 0; i < GC_CENSUS_OCCUPANCY; i++)
+    {
+        total.arena_pages[i] += part.arena_pages[i];
+    }
+}
+
+// Heap objects are malloc blocks, so fragmentation among them is malloc's. Free chunks below the top of
+// an arena cannot be trimmed and are what a fragmented heap accumulates.
+void census_malloc_stats(gc_census& census) {
+    struct mallinfo2 info = mallinfo2();
+    census.malloc_bytes = info.arena + info.hblkhd;
+    census.malloc_used_bytes = info.uordblks + info.hblkhd;
+    census.malloc_free_bytes = info.fordblks;
+    census.malloc_fragmented_bytes = info.fordblks - info.keepcost;
+}
+
+static void write_array(FILE* out, const unsigned long long* values, size_t cnt) {
+    fprintf(out, "[");
+    for (size_t i = 0; i < cnt; i++)
+    {
+        fprintf(out, "%s%llu", i == 0 ? "" : ",", values[i]);
+    }
+    fprintf(out, "]");
+}
+
+static void write_json(FILE* out, const gc_census& census) {
+    fprintf(out, "{\"collections\":%llu,\"objects\":%llu,\"bytes\":%llu,\"class_objects\":",
+            census.collections, census.objects, census.bytes);
+    write_array(out, census.class_objects, GC_CENSUS_CLASSES);
+    fprintf(out, ",\"class_bytes\":");
+    write_array(out, census.class_bytes, GC_CENSUS_CLASSES);
+    fprintf(out, ",\"large_objects\":%llu,\"large_bytes\":%llu,\"movable_objects\":%llu,\"movable_bytes\":%llu"
+                 ",\"arena_bytes\":%llu,\"arena_free_bytes\":%llu,\"arena_fragmented_bytes\":%llu,\"arena_pages\":",
+            census.large_objects, census.large_bytes, census.movable_objects, census.movable_bytes,
+            census.arena_bytes, census.arena_free_bytes, census.arena_fragmented_bytes);
+    write_array(out, census.arena_pages, GC_CENSUS_OCCUPANCY);
+    fprintf(out, "}");
+}
+
+static void write_text(FILE* out, const gc_census& census) {
+    fprintf(out, "  collections: %llu\n", census.collections);
+    fprintf(out, "  live: %llu objects, %llu bytes\n", census.objects, census.bytes);
+    fprintf(out, "  large (>= %d bytes): %llu objects, %llu bytes\n",
+            GC_CENSUS_LARGE_BYTES, census.large_objects, census.large_bytes);
+    fprintf(out, "  movable: %llu objects, %llu bytes\n", census.movable_objects, census.movable_bytes);
+    for (size_t i = 0; i < GC_CENSUS_CLASSES; i++)
+    {
+        if (census.class_objects[i] == 0) { continue; }
+        if (i == GC_CENSUS_CLASSES - 1)
+        {
+            fprintf(out, "  class > %llu: ", 16ull << (i - 1));
+        } else
+        {
+            fprintf(out, "  class <= %llu: ", 16ull << i);
+        }
+        fprintf(out, "%llu objects, %llu bytes\n", census.class_objects[i], census.class_bytes[i]);
+    }
+    fprintf(out, "  arenas: %llu bytes, %llu free, %llu fragmented\n",
+            census.arena_bytes, census.arena_free_bytes, census.arena_fragmented_bytes);
+    fprintf(out, "  arena pages by occupancy:");
+    for (size_t i = 0; i < GC_CENSUS_OCCUPANCY; i++)
+    {
+        fprintf(out, " %zu%%:%llu", i * 10, census.arena_pages[i]);
+    }
+    fprintf(out, "\n");
+}
+
+bool census_write(const char* path, int format, const std::vector<std::pair<pthread_t, gc_census>>& heaps,
+                  const gc_census& total) {
+    FILE* out = fopen(path, "w");
+    if (out == NULL)
+    {
+        LOG_WARNING("Failed to open census file %s", path);
+        return false;
+    }
+
+    if (format == GC_CENSUS_JSON)
+    {
+        fprintf(out, "{\"heaps\":[");
+        for (size_t i = 0; i < heaps.size(); i++)
+        {
+            fprintf(out, "%s{\"tid\":%llu,\"census\":", i == 0 ? "" : ",", (unsigned long long)heaps[i].first);
+            write_json(out, heaps[i].second);
+            fprintf(out, "}");
+        }
+        fprintf(out, "],\"total\":");
+        write_json(out, total);
+        fprintf(out, ",\"malloc\":{\"bytes\":%llu,\"used_bytes\":%llu,\"free_bytes\":%llu,\"fragmented_bytes\":%llu}}\n",
+                total.malloc_bytes, total.malloc_used_bytes, total.malloc_free_bytes, total.malloc_fragmented_bytes);
+    } else
+    {
+        for (const auto& [tid, census] : heaps)
+        {
+            fprintf(out, "heap %llu\n", (unsigned long long)tid);
+            write_text(out, census);
+        }
+        fprintf(out, "total\n");
+        write_text(out, total);
+        fprintf(out, "malloc: %llu bytes, %llu used, %llu free, %llu fragmented\n",
+                total.malloc_bytes, total.malloc_used_bytes, total.malloc_free_bytes, total.malloc_fragmented_bytes);
+    }
+
+    fclose(out);
+    return true;
+}
+
+// The signal handler only writes a byte to a pipe, the dump itself is written by a thread reading it.
+class census_signal {
+private:
+    std::mutex mtx_;
+    std::string path_;
+    int format_ = GC_CENSUS_TEXT;
+    int pipe_[2] = {-1, -1};
+
+    void dump_loop() {
+        char byte;
+        while (read(pipe_[0], &byte, 1) != 0)
+        {
+            std::string path;
+            int format;
+            {
+                std::lock_guard census_lock(mtx_);
+                path = path_;
+                format = format_;
+            }
+            gc_census_dump(path.c_str(), format);
+        }
+    }
+public:
+    int wr_fd = -1;
+
+    bool configure(const char* path, int format) {
+        std::lock_guard census_lock(mtx_);
+        path_ = path;
+        format_ = format;
+        if (pipe_[0] >= 0) { return true; }
+
+        if (pipe2(pipe_, O_CLOEXEC) != 0) { return false; }
+        fcntl(pipe_[1], F_SETFL, O_NONBLOCK);
+        wr_fd = pipe_[1];
+        // Lives as long as the process, the pipe is never closed
+        std::thread(&census_signal::dump_loop, this).detach();
+        return true;
+    }
+};
+
+static census_signal census_on_signal;
+
+static void handle_census_signal(int) {
+    int saved_errno = errno;
+    if (write(census_on_signal.wr_fd, "c", 1) < 0) {}
+    errno = saved_errno;
+}
+
+int gc_census_on_signal(int signo, const char* path, int format) {
+    if (path == NULL || (format != GC_CENSUS_TEXT && format != GC_CENSUS_JSON))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (!census_on_signal.configure(path, format)) { return -1; }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_census_signal;
+    sa.sa_flags = SA_RESTART;
+    return sigaction(signo, &sa, NULL);
+}
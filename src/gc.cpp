@@ -1,30 +1,74 @@
 #include "gc/gc.h"
 #include "gc/log.h"
 #include "gc/thread-pool.h"
+#include "gc/trace.h"
+#include "gc/movable-space.h"
+#include "gc/region.h"
+#include "gc/profiler.h"
+#include "gc/recorder.h"
+#include "gc/numa.h"
+#include "gc/dirty-pages.h"
+#include "gc/census.h"
+#include "gc/latency.h"
+#include "gc/pressure.h"
+#include "gc/policy.h"
+#include "gc/data-segments.h"
 
 #include <iostream>
+#include <optional>
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
 #include <thread>
 #include <csetjmp>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include <errno.h>
 #include <limits.h>
-
-#undef LOG_LVL
-#define LOG_LVL LOG_LEVEL::INFO
-
-#define MAX_MEM_CAPACITY UINT64_MAX
-#define INITIAL_SWEEP_FACTOR 1024
+#include <time.h>
+#include <malloc.h>
+
+#define BACKGROUND_PERIOD_MS 10
+#define RETIRED_HEAPS_MAX 16
+#define SERIAL_BATCH 1024
+#define SNAPSHOT_BATCH 1024
+#define RETIRED_BUCKETS_MAX (1 << 16)
+#define ZCT_BATCH 1024
+#define REMARK_MAX_PASSES 8
+
+// Configuration of the collector, one of the *_config structs of gc/policy.h.
+#ifndef GC_CONFIG
+#define GC_CONFIG default_config
+#endif
 
 enum class ETAG {
     NONE,
     USED,
 };
 
+enum ALLOC_FLAG : uint32_t {
+    ALLOC_ZEROED = 1,   // block comes from calloc
+    ALLOC_NO_SCAN = 2,  // block holds no pointers, it is marked but never scanned
+    ALLOC_COUNTED = 4,  // block is reference counted, see gc::process_zct
+};
+
+// Phase of a time-budgeted collection cycle, see gc::collect_step.
+enum class ECYCLE {
+    IDLE,
+    MARK,
+    REMARK,
+    SWEEP,
+};
+
 enum class EERROR {
     NONE,
     NOMEM,
+    BUDGET,             // heap hard budget reached even after a collection
+    PROCESS_BUDGET,     // process hard budget reached, a global collection may help
+    PROCESS_SOFT,       // allocated, but the process soft budget is reached
+    INVAL,              // the block does not belong to the heap
 };
 
 struct alloc_info
@@ -32,9 +76,43 @@ struct alloc_info
     void* addr;
     size_t size;
     ETAG tag;
+    bool has_weak;
+    bool no_scan;
+    alloc_site* site;
+    uint32_t epoch;         // marked by the budgeted cycle with this epoch
+    uint64_t scan_hash;     // content hash when the budgeted cycle scanned it, 0 if not scanned
+    uint64_t serial;        // unique over all heaps, tells a block from a later one at the same address
+    bool counted;           // allocated with GC_MALLOC_RC
+    bool in_zct;            // counted and waiting in the zero count table of its heap
+    uint32_t rc;            // references from GC memory, references from roots are not counted
+};
+
+// Unreachable allocation found by the snapshot child, see gc_manager::snapshot_run.
+struct snapshot_record
+{
+    uint64_t heap;
+    uint64_t addr;
+    uint64_t serial;
+};
+
+struct gc_weak_ref
+{
+    void* target;
 };
 
+// Bytes of live allocations of all heaps, 0 budgets mean unlimited.
+std::atomic<uint64_t> process_live_bytes = 0;
+std::atomic<uint64_t> process_soft_budget = 0;
+std::atomic<uint64_t> process_hard_budget = 0;
+std::atomic<bool>     process_soft_reached = false;
+
+// Heaps take serials in batches, so the counter is touched once per SERIAL_BATCH allocations.
+std::atomic<uint64_t> alloc_serials = 1;
+
 std::atomic<bool> is_global_collecting = false;
+
+// Roots of the heaps created with GC_FLAG_SCAN_DATA.
+data_segments data_roots;
 std::atomic<bool>            is_stoped = false;
 
 std::condition_variable gr_manager_cv; // global run manager cv
@@ -43,10 +121,20 @@ std::mutex              gr_manager_mtx;
 std::condition_variable handle_cv;
 std::mutex              handle_mtx;
 
+// Points to the stack pointer slot of this thread's gc, filled when the thread is stopped.
+thread_local std::atomic<void*>* stopped_sp_slot = NULL;
+
 void handle_sigusr1(int sig) {
     if (sig == SIGUSR1)
     {   
+        // Registers of the interrupted code are saved in the signal frame above this one.
+        volatile char stack_marker = 0;
+        if (stopped_sp_slot != NULL)
+        {
+            stopped_sp_slot->store((void*)&stack_marker);
+        }
         LOG_DEBUG("%s", "I am stopped");
+        latency_part blocked(GC_LATENCY_BLOCKED);
         is_stoped.store(true);
         gr_manager_cv.notify_one();
 
@@ -59,255 +147,2248 @@ void handle_sigusr1(int sig) {
     }
 }
 
-class gc {
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Heap of one thread, built from the policies of gc/policy.h.
+template<typename AllocatorPolicy, typename IndexPolicy, typename ScanPolicy, typename TriggerPolicy>
+class basic_gc {
 private:
-    uint64_t sweep_factor;
-    uint64_t cur_mem_capacity;
+    // Atomic because the background collector thread watches them.
+    std::atomic<uint64_t> sweep_factor;
+    std::atomic<uint64_t> cur_mem_capacity;
+    std::atomic<uint64_t> allocated_since_collect_ = 0;
+    uint64_t background_ops_seen_ = 0;
+    bool background_ = false;
+
+    uint64_t live_bytes_ = 0;
+    uint64_t soft_budget_ = 0;
+    uint64_t hard_budget_ = 0;
+    bool soft_reached_ = false;
 
     std::unordered_set<void*> roots_;
-    std::unordered_map<void*, alloc_info*> allocs_reg_;
+    gc_root_node* root_list_ = NULL;    // sentinel of the owner's intrusive root list, see gc.hpp
+    typename IndexPolicy::template map<void*, alloc_info*> allocs_reg_;
+    std::unordered_set<gc_weak_ref*> weak_refs_;
+
+    // Lowest and highest address of the heap's blocks, a quick filter for words of the data segments.
+    uintptr_t blocks_lo_ = UINTPTR_MAX;
+    uintptr_t blocks_hi_ = 0;
+    bool scan_data_ = false;        // GC_FLAG_SCAN_DATA was given
+    std::vector<void*> data_values_;
+
+    movable_space movable_;
+    char* stack_hi_;
+    int node_ = -1;     // NUMA node of the owner thread, -1 when placement does not matter
+    bool huge_pages_ = false;
+
+    // Open GC_REGION_BEGIN scopes, innermost last. The arena of the last closed one is kept for reuse.
+    std::vector<region_arena*> regions_;
+    region_arena* spare_region_ = NULL;
+
+    // Allocations handed over by other heaps, merged by the next operation on this heap.
+    std::mutex inbox_mtx_;
+    std::vector<alloc_info*> inbox_;
+    std::vector<void*> inbox_held_;
+    std::atomic<size_t> inbox_cnt_ = 0;
+
+    // Objects kept alive by the heap itself rather than by a root variable. Used by the orphan heap.
+    std::unordered_set<void*> held_;
+
+    bool adopt_on_stop_ = false;
+    pthread_t heir_;
+
+    // Budgeted cycle. Marks are the cycle's epoch instead of ETAG, so they never have to be reset,
+    // and objects allocated while a cycle runs are born marked.
+    ECYCLE cycle_ = ECYCLE::IDLE;
+    uint32_t epoch_ = 0;
+    bool dirty_pages_ = false;      // GC_FLAG_DIRTY_PAGES was given
+    bool dirty_tracked_ = false;    // the running cycle has soft-dirty tracking, see dirty-pages.h
+    std::vector<void*> grey_;
+    std::vector<void*> marked_;     // scannable objects marked by the running cycle, checked by the remark
+    uint32_t remark_passes_ = 0;
+    std::vector<void*> sweep_list_;
+    size_t sweep_pos_ = 0;
+
+    uint64_t serial_next_ = 0;
+    uint64_t serial_end_ = 0;
+
+    // Census of the survivors of the running sweep, published when it finishes.
+    gc_census census_next_ = {};
+    uint64_t collections_ = 0;
+    std::mutex census_mtx_;
+    gc_census census_ = {};
+
+    // Zero count table: counted objects whose count dropped to 0. They are freed in batches once no root
+    // refers to them, so stores to root variables never touch the counts.
+    std::vector<void*> zct_;
+    size_t zct_limit_ = ZCT_BATCH;
+
+    // Unreachable allocations reported by a snapshot collection, freed by the next operation on the heap.
+    std::mutex lazy_mtx_;
+    std::vector<std::pair<void*, uint64_t>> lazy_free_;
+    std::atomic<size_t> lazy_cnt_ = 0;
+
+    uint64_t next_serial() {
+        if (serial_next_ == serial_end_)
+        {
+            serial_next_ = alloc_serials.fetch_add(SERIAL_BATCH, std::memory_order_relaxed);
+            serial_end_ = serial_next_ + SERIAL_BATCH;
+        }
+        return serial_next_++;
+    }
+
+    void free_lazy() {
+        std::vector<std::pair<void*, uint64_t>> batch;
+        {
+            std::lock_guard lazy_lock(lazy_mtx_);
+            batch.swap(lazy_free_);
+            lazy_cnt_.store(0, std::memory_order_release);
+        }
+        for (const auto& [addr, serial] : batch)
+        {
+            // Skips blocks freed since the snapshot, and new blocks that reuse their address
+            auto itr = allocs_reg_.find(addr);
+            if (itr == allocs_reg_.end() || itr->second->serial != serial) { continue; }
+            gc_free(addr);
+        }
+    }
+
+    void adopt_pending() {
+        if (lazy_cnt_.load(std::memory_order_acquire) != 0) [[unlikely]] { free_lazy(); }
+        if (inbox_cnt_.load(std::memory_order_acquire) == 0) [[likely]] { return; }
+
+        std::lock_guard inbox_lock(inbox_mtx_);
+        for (auto alloc : inbox_)
+        {
+            if (cycle_ != ECYCLE::IDLE) { shade_new(alloc); }
+            if (alloc->in_zct) { zct_.push_back(alloc->addr); }
+            index_block(alloc);
+            cur_mem_capacity += alloc->size;
+            live_bytes_ += alloc->size;
+        }
+        held_.insert(inbox_held_.begin(), inbox_held_.end());
+        inbox_.clear();
+        inbox_held_.clear();
+        inbox_cnt_.store(0, std::memory_order_release);
+    }
+
+    void index_block(alloc_info* alloc) {
+        allocs_reg_.insert({alloc->addr, alloc});
+        uintptr_t addr = reinterpret_cast<uintptr_t>(alloc->addr);
+        if (addr < blocks_lo_) { blocks_lo_ = addr; }
+        if (addr > blocks_hi_) { blocks_hi_ = addr; }
+    }
+
+    template<typename F>
+    void scan_words(char* begin, char* end, F&& visit) {
+        if constexpr (ScanPolicy::step > 1)
+        {
+            uintptr_t misaligned = reinterpret_cast<uintptr_t>(begin) % ScanPolicy::step;
+            if (misaligned != 0) { begin += ScanPolicy::step - misaligned; }
+        }
+        for (char* mem_block = begin; mem_block + sizeof(void*) <= end; mem_block += ScanPolicy::step)
+        {
+            visit(*reinterpret_cast<void**>(mem_block));
+        }
+    }
+
+    void scan_range(char* begin, char* end) {
+        scan_words(begin, end, [this](void* val) { mark_value(val); });
+    }
 
     void scan_allocation(alloc_info* alloc) {
         if (alloc->tag == ETAG::USED) { return; }
         
         alloc->tag = ETAG::USED;
         LOG_DEBUG("Mark %p", alloc->addr);
+        if (alloc->no_scan) { return; }
+
+        scan_range(reinterpret_cast<char*>(alloc->addr), reinterpret_cast<char*>(alloc->addr) + alloc->size);
+    }
+
+    void scan_movable(gc_handle_entry* entry) {
+        if (entry->flags & MOVABLE_MARKED) { return; }
+
+        entry->flags |= MOVABLE_MARKED;
+        scan_range(static_cast<char*>(entry->addr), static_cast<char*>(entry->addr) + entry->size);
+    }
+
+    // Movable objects referenced through their handle may be moved. A direct pointer into one pins it.
+    bool mark_movable(void* val) {
+        if (movable_.empty()) { return false; }
 
-        for (char* mem_block = reinterpret_cast<char*>(alloc->addr);
-             mem_block < reinterpret_cast<char*>(alloc->addr) + alloc->size;
-             ++mem_block)
+        gc_handle_entry* entry = movable_.find_handle(val);
+        if (entry == NULL)
+        {
+            entry = movable_.find_object(val);
+            if (entry == NULL) { return false; }
+            entry->flags |= MOVABLE_PINNED;
+        }
+        scan_movable(entry);
+        return true;
+    }
+
+    void mark_value(void* val) {
+        auto itr = allocs_reg_.find(val);
+        if (itr != allocs_reg_.end())
         {
-            auto itr = allocs_reg_.find(*reinterpret_cast<void**>(mem_block));
-            if (itr == allocs_reg_.end()) { continue; }
             scan_allocation(itr->second);
-        }   
+            return;
+        }
+        mark_movable(val);
+    }
+
+    // The collector does not treat the stack as a root for regular allocations, but movable objects
+    // referenced from it may be in use through a raw pointer, so they are kept alive and pinned.
+    void scan_stack() {
+        char* sp = static_cast<char*>(stopped_sp.load());
+        if (sp == NULL || stack_hi_ == NULL || sp >= stack_hi_) { return; }
+
+        for (void** slot = reinterpret_cast<void**>(arena_round_up(reinterpret_cast<uintptr_t>(sp), sizeof(void*)));
+             reinterpret_cast<char*>(slot) + sizeof(void*) <= stack_hi_;
+             ++slot)
+        {
+            mark_movable(*slot);
+        }
     }
 
-    void mark() {
+    // Values of the variables marked with mark_root and of the intrusive root list.
+    template<typename F>
+    void for_each_root_value(F&& visit) {
         for (const auto &root : roots_)
         {
-            auto itr = allocs_reg_.find(*static_cast<void**>(root));
-            if (itr != allocs_reg_.end())
+            visit(*static_cast<void**>(root));
+        }
+        if (root_list_ == NULL) { return; }
+        for (gc_root_node* node = root_list_->next; node != root_list_; node = node->next)
+        {
+            visit(node->ptr);
+        }
+    }
+
+    // Words of the data segments that may point into the heap. When `stopped`, a stopped thread may hold the
+    // loader lock, so the list read by data_roots.refresh() before the stop is scanned without it and the words
+    // are visited as they are read. Otherwise they are filtered under the lock, and visited once it is released.
+    template<typename F>
+    void for_each_data_value(bool stopped, F&& visit) {
+        if (!scan_data_) { return; }
+
+        auto in_heap = [this](void* val) -> bool {
+            uintptr_t addr = reinterpret_cast<uintptr_t>(val);
+            if (addr >= blocks_lo_ && addr <= blocks_hi_) { return true; }
+            return !movable_.empty() && (movable_.find_handle(val) != NULL || movable_.find_object(val) != NULL);
+        };
+        if (stopped)
+        {
+            data_roots.scan_cached([&in_heap, &visit](void* val) {
+                if (in_heap(val)) { visit(val); }
+            });
+            return;
+        }
+
+        data_values_.clear();
+        data_roots.scan([this, &in_heap](void* val) {
+            if (in_heap(val)) { data_values_.push_back(val); }
+        });
+        for (auto val : data_values_)
+        {
+            visit(val);
+        }
+    }
+
+    // `stopped` is set when threads are stopped by SIGUSR1 around the marking, see for_each_data_value.
+    void mark(bool with_stack, bool stopped) {
+        TRACE_BEGIN(MARK, this);
+        for_each_root_value([this](void* val) { mark_value(val); });
+        for_each_data_value(stopped, [this](void* val) { mark_value(val); });
+        for (auto obj : held_)
+        {
+            mark_value(obj);
+        }
+        for (auto entry : movable_.pinned())
+        {
+            scan_movable(entry);
+        }
+        if (with_stack && !movable_.empty())
+        {
+            scan_stack();
+        }
+        // Region objects are not collected, but may be the only owners of heap objects.
+        for (auto region : regions_)
+        {
+            for (const auto& chunk : region->chunks())
+            {
+                scan_range(chunk.base, chunk.base + chunk.top);
+            }
+        }
+        TRACE_END(MARK, this);
+    }
+
+    // Weak references do not keep their targets alive, so clear those that point to unmarked allocations.
+    void clear_weak_refs() {
+        for (auto ref : weak_refs_)
+        {
+            if (ref->target == NULL) { continue; }
+
+            auto itr = allocs_reg_.find(ref->target);
+            if (itr == allocs_reg_.end() || itr->second->tag != ETAG::USED)
             {
-                scan_allocation(itr->second);
+                ref->target = NULL;
             }
         }
     }
 
     void sweep() {
-        std::erase_if(allocs_reg_, [](const auto& item) -> bool {
+        TRACE_BEGIN(SWEEP, this);
+        census_next_ = {};
+        if (!weak_refs_.empty())
+        {
+            clear_weak_refs();
+        }
+        uint64_t freed = 0;
+        std::erase_if(allocs_reg_, [this, &freed](const auto& item) -> bool {
             auto const& [key, value] = item;
             if (value->tag == ETAG::USED) { return false; }
-            LOG_INFO("Sweep %p", key)
-            free(key);
+            freed += value->size;
+            TRACE_OBJECT(SWEEP_OBJECT, key);
+            if (value->counted) { release_children(value); }
+            if (value->site != NULL) { profiler_release(value->site, value->size); }
+            AllocatorPolicy::release(key, value->size);
             delete value;
             return true;
         });
 
-        std::for_each(allocs_reg_.begin(), allocs_reg_.end(), [](auto& item){
+        std::for_each(allocs_reg_.begin(), allocs_reg_.end(), [this](auto& item){
             auto& [key, value] = item;
             value->tag = ETAG::NONE;
+            census_add_object(census_next_, value->size);
         });
+        account_free(freed);
+        TRACE_END(SWEEP, this);
     }
-public:
-    unsigned long long int get_allocs_cnt() {
-        return allocs_reg_.size();
+
+    // Hashing is much cheaper than scanning, so the remark only rescans objects whose content changed.
+    static uint64_t content_hash(const void* mem, size_t size) {
+        const char* bytes = static_cast<const char*>(mem);
+        uint64_t hash = 14695981039346656037ull ^ size;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, bytes + i, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+        for (; i < size; i++)
+        {
+            hash = (hash ^ static_cast<unsigned char>(bytes[i])) * 1099511628211ull;
+        }
+        return hash | 1;
     }
 
-    unsigned long long int get_roots_cnt() {
-        return roots_.size();
+    // An object allocated or adopted during a cycle survives it, and is scanned if the cycle is still marking.
+    void shade_new(alloc_info* alloc) {
+        alloc->epoch = epoch_;
+        alloc->scan_hash = 0;
+        if (cycle_ == ECYCLE::MARK || cycle_ == ECYCLE::REMARK)
+        {
+            grey_.push_back(alloc->addr);
+            if (!alloc->no_scan) { marked_.push_back(alloc->addr); }
+        }
     }
 
-    void gc_malloc(size_t size, void*& res, EERROR& error) {
-        if (cur_mem_capacity >= sweep_factor)
+    void shade_value(void* val) {
+        auto itr = allocs_reg_.find(val);
+        if (itr != allocs_reg_.end())
+        {
+            alloc_info* alloc = itr->second;
+            if (alloc->epoch == epoch_) { return; }
+            alloc->epoch = epoch_;
+            alloc->scan_hash = 0;
+            grey_.push_back(val);
+            if (!alloc->no_scan) { marked_.push_back(val); }
+            return;
+        }
+        if (movable_.empty()) { return; }
+
+        gc_handle_entry* entry = movable_.find_handle(val);
+        if (entry == NULL)
+        {
+            entry = movable_.find_object(val);
+            if (entry == NULL) { return; }
+            entry->flags |= MOVABLE_PINNED;
+        }
+        if (entry->flags & MOVABLE_MARKED) { return; }
+        entry->flags |= MOVABLE_MARKED;
+        shade_range(static_cast<char*>(entry->addr), static_cast<char*>(entry->addr) + entry->size);
+    }
+
+    void shade_range(char* begin, char* end) {
+        scan_words(begin, end, [this](void* val) { shade_value(val); });
+    }
+
+    void shade_roots() {
+        for_each_root_value([this](void* val) { shade_value(val); });
+        for_each_data_value(false, [this](void* val) { shade_value(val); });
+        for (auto obj : held_)
+        {
+            shade_value(obj);
+        }
+        for (auto entry : movable_.pinned())
+        {
+            shade_value(entry);
+        }
+        for (auto region : regions_)
         {
-            LOG_INFO("%s", "GC backgroung collection");
-            collect();
-            if (MAX_MEM_CAPACITY / 2 > sweep_factor)
+            for (const auto& chunk : region->chunks())
             {
-                sweep_factor *= 2;
+                shade_range(chunk.base, chunk.base + chunk.top);
             }
         }
-        
-        res = malloc(size);
+    }
 
-        if (errno == ENOMEM || errno == EAGAIN)
+    // Scans grey objects until none are left or the deadline passes. A deadline of 0 means none.
+    // At least one object is scanned per call, so that every slice makes progress.
+    bool drain_grey(uint64_t deadline) {
+        for (bool first = true; !grey_.empty(); first = false)
         {
-            error = EERROR::NOMEM;
-            return;
+            if (deadline != 0 && !first && now_ns() >= deadline) { return false; }
+
+            void* addr = grey_.back();
+            grey_.pop_back();
+            auto itr = allocs_reg_.find(addr);
+            if (itr == allocs_reg_.end()) { continue; }
+
+            alloc_info* alloc = itr->second;
+            if (alloc->no_scan) { continue; }
+            if (!dirty_tracked_) { alloc->scan_hash = content_hash(alloc->addr, alloc->size); }
+            shade_range(static_cast<char*>(alloc->addr), static_cast<char*>(alloc->addr) + alloc->size);
         }
+        return true;
+    }
 
-        error = EERROR::NONE;
-        alloc_info* allocation = new alloc_info;
-        allocation->addr = res;
-        allocation->size = size;
-        allocation->tag = ETAG::NONE;
+    // The mutator ran between the slices, so roots and every object it may have written are scanned again.
+    // Without a write barrier, the kernel's soft-dirty bits or a changed content hash tell the latter. A pass
+    // only counts if the mutator did not run during it, so every call starts a new one and marking ends with
+    // the first pass that completes within its slice. After REMARK_MAX_PASSES interrupted passes one runs
+    // without the deadline, otherwise a heap that cannot be checked within the budget would never be swept.
+    bool remark(uint64_t deadline) {
+        if (++remark_passes_ > REMARK_MAX_PASSES) { deadline = 0; }
+
+        shade_roots();
+        movable_.for_each_marked([this](gc_handle_entry* entry) {
+            shade_range(static_cast<char*>(entry->addr), static_cast<char*>(entry->addr) + entry->size);
+        });
+        if (!drain_grey(deadline)) { return false; }
 
-        allocs_reg_.insert({res, allocation});
-        cur_mem_capacity += size;
-        LOG_DEBUG("Malloc at %p size of %lu", res, size);
+        // Objects marked during the pass are appended to marked_ and checked by it too
+        std::optional<dirty_reader> reader;
+        if (dirty_tracked_)
+        {
+            // The reader reads pagemap a window at a time, which only saves reads when the checks go
+            // in address order. The order of marked_ does not matter otherwise.
+            std::sort(marked_.begin(), marked_.end());
+            reader.emplace();
+        }
+        for (size_t pos = 0; pos < marked_.size(); ++pos)
+        {
+            if (deadline != 0 && pos != 0 && (pos & 63) == 0 && now_ns() >= deadline) { return false; }
+
+            auto itr = allocs_reg_.find(marked_[pos]);
+            if (itr == allocs_reg_.end()) { continue; }
+            alloc_info* alloc = itr->second;
+            bool written = reader.has_value() ? reader->is_dirty(alloc->addr, alloc->size) :
+                                                alloc->scan_hash != content_hash(alloc->addr, alloc->size);
+            if (!written) { continue; }
+
+            grey_.push_back(alloc->addr);
+            if (!drain_grey(deadline)) { return false; }
+        }
+
+        if (dirty_tracked_)
+        {
+            // Writes after this point are seen by the pause-free sweep only as allocations, which are born marked.
+            dirty_end();
+            dirty_tracked_ = false;
+        }
+
+        for (auto ref : weak_refs_)
+        {
+            if (ref->target == NULL) { continue; }
+
+            auto itr = allocs_reg_.find(ref->target);
+            if (itr == allocs_reg_.end() || itr->second->epoch != epoch_)
+            {
+                ref->target = NULL;
+            }
+        }
+        return true;
     }
 
-    void gc_free(void* addr) {
-        auto itr = allocs_reg_.find(addr);
-        if (itr == allocs_reg_.end())
+    bool sweep_slice(uint64_t deadline) {
+        uint64_t freed = 0;
+        bool done = true;
+        for (size_t visited = 0; sweep_pos_ < sweep_list_.size(); ++sweep_pos_, ++visited)
         {
-            return;
+            if (deadline != 0 && visited != 0 && (visited & 63) == 0 && now_ns() >= deadline)
+            {
+                done = false;
+                break;
+            }
+
+            auto itr = allocs_reg_.find(sweep_list_[sweep_pos_]);
+            if (itr == allocs_reg_.end()) { continue; }
+            if (itr->second->epoch == epoch_)
+            {
+                census_add_object(census_next_, itr->second->size);
+                continue;
+            }
+
+            alloc_info* alloc = itr->second;
+            freed += alloc->size;
+            TRACE_OBJECT(SWEEP_OBJECT, alloc->addr);
+            if (alloc->counted) { release_children(alloc); }
+            if (alloc->site != NULL) { profiler_release(alloc->site, alloc->size); }
+            AllocatorPolicy::release(alloc->addr, alloc->size);
+            delete alloc;
+            allocs_reg_.erase(itr);
         }
-        
-        LOG_DEBUG("Free %p", addr);
-        cur_mem_capacity -= itr->second->size;
+        account_free(freed);
+        return done;
+    }
 
-        free(addr);
-        delete itr->second;
-        allocs_reg_.erase(itr);
+    // Adds the arenas to the census of the finished sweep and makes it visible to gc_heap_census.
+    void publish_census() {
+        census_next_.collections = ++collections_;
+        movable_.census(census_next_);
+        for (auto region : regions_)
+        {
+            region->census(census_next_);
+        }
+        if (spare_region_ != NULL) { spare_region_->census(census_next_); }
+
+        std::lock_guard census_lock(census_mtx_);
+        census_ = census_next_;
     }
 
-    void mark_root(void* addr) {
-        roots_.insert(addr);
+    void queue_zero(alloc_info* alloc) {
+        if (alloc->in_zct) { return; }
+        alloc->in_zct = true;
+        zct_.push_back(alloc->addr);
     }
 
-    void unmark_root(void* addr) {
-        if (!roots_.contains(addr)) { return; }
-        
-        roots_.erase(addr);
+    // A freed counted object drops the references it held. They are expected at pointer-aligned offsets,
+    // where the compiler puts pointer fields, so that unaligned byte patterns never lower a count.
+    void release_children(alloc_info* alloc) {
+        if (alloc->no_scan) { return; }
+
+        void** begin = static_cast<void**>(alloc->addr);
+        for (void** slot = begin; slot < begin + alloc->size / sizeof(void*); ++slot)
+        {
+            auto itr = allocs_reg_.find(*slot);
+            if (itr == allocs_reg_.end()) { continue; }
+
+            alloc_info* child = itr->second;
+            if (!child->counted || child->rc == 0) { continue; }
+            if (--child->rc == 0) { queue_zero(child); }
+        }
     }
 
-    void collect() {
-        mark();
-        sweep();
+    // A full collection supersedes the running cycle.
+    void abort_cycle() {
+        if (cycle_ == ECYCLE::IDLE) { return; }
+
+        if (dirty_tracked_)
+        {
+            dirty_end();
+            dirty_tracked_ = false;
+        }
+        movable_.clear_marks();
+        grey_.clear();
+        marked_.clear();
+        sweep_list_.clear();
+        cycle_ = ECYCLE::IDLE;
     }
+public:
+    std::atomic<void*> stopped_sp = NULL;
+    profiler_sampler sampler;
 
-    gc() {
-        cur_mem_capacity = 0;
-        sweep_factor = INITIAL_SWEEP_FACTOR;
+    int node() {
+        return node_;
     }
 
-    ~gc() {
-        for (const auto& alloc : allocs_reg_) {
-            free(alloc.first);
-            delete alloc.second;
+    // Runs in the snapshot child: marks the heap and passes every unreachable allocation to `emit`.
+    // Must neither allocate nor take locks, threads of the parent may have held them at the fork.
+    // Weakly referenced allocations are left to regular collections: until the lazy free, weak_get in the
+    // parent would still hand them out.
+    template<typename F>
+    void snapshot_garbage(F&& emit) {
+        // stopped_sp was recorded before the fork, so movable objects referenced from the stack are kept
+        mark(true, true);
+        for (const auto& [addr, alloc] : allocs_reg_)
+        {
+            if (alloc->tag != ETAG::USED && !alloc->has_weak) { emit(addr, alloc->serial); }
         }
     }
-};
 
-class gc_manager
-{
-private:
-    std::mutex global_run_mtx;
-    std::mutex reg_mtx_;
-    std::unordered_map<pthread_t, gc*> reg_;
-    thread_pool tpool_;
-    size_t gc_cnt;
+    void queue_lazy_free(const std::vector<std::pair<void*, uint64_t>>& garbage) {
+        std::lock_guard lazy_lock(lazy_mtx_);
+        lazy_free_.insert(lazy_free_.end(), garbage.begin(), garbage.end());
+        lazy_cnt_.store(lazy_free_.size(), std::memory_order_release);
+    }
 
-    gc* get_gc(pthread_t tid) {
-        std::lock_guard reg_lock(reg_mtx_);
-        if (!reg_.contains(tid))
+    void set_dirty_pages(bool dirty_pages) {
+        dirty_pages_ = dirty_pages;
+    }
+
+    void set_scan_data(bool scan_data) {
+        scan_data_ = scan_data;
+    }
+
+    // Arenas mapped from now on are backed by transparent huge pages where the kernel allows it.
+    void set_huge_pages(bool huge_pages) {
+        huge_pages_ = huge_pages;
+        movable_.set_huge_pages(huge_pages);
+        if (spare_region_ != NULL) { spare_region_->set_huge_pages(huge_pages); }
+        for (auto region : regions_)
         {
-            LOG_CRITICAL("Thread with id: %lld does not have GC", (long long int)tid);
-            // std::exit(EXIT_FAILURE);
-            errno = EINVAL;
-            return NULL;
+            region->set_huge_pages(huge_pages);
         }
-        
-        return reg_[tid];
     }
 
-    void global_run(pthread_t origin_tid) {
-        if (is_global_collecting.load()) { return; }
-        is_global_collecting.store(true);
-        std::lock_guard run_lock(global_run_mtx);
-        LOG_INFO("%s", "Start global gc");
-        tpool_.block();
-        tpool_.wait_all();
-        
+    unsigned long long int get_huge_page_bytes() {
+        size_t bytes = movable_.huge_bytes() + (spare_region_ != NULL ? spare_region_->huge_bytes() : 0);
+        for (auto region : regions_)
+        {
+            bytes += region->huge_bytes();
+        }
+        return bytes;
+    }
 
-        for (const auto&[key, val] : reg_) {
-            if (key == origin_tid) { continue; }
-            is_stoped.store(false);
-            pthread_kill(key, SIGUSR1);
+    // Can be called from any thread.
+    void get_census(gc_census& census) {
+        std::lock_guard census_lock(census_mtx_);
+        census = census_;
+    }
 
-            std::unique_lock collection_lock(gr_manager_mtx);
-            gr_manager_cv.wait(collection_lock, [](){
-                return is_stoped.load();
+    unsigned long long int get_allocs_cnt() {
+        return allocs_reg_.size() + movable_.count() + inbox_cnt_.load();
+    }
+
+    void set_heir(pthread_t heir) {
+        adopt_on_stop_ = true;
+        heir_ = heir;
+    }
+
+    bool get_heir(pthread_t& heir) {
+        heir = heir_;
+        return adopt_on_stop_;
+    }
+
+    // Takes `root` and every allocation reachable from it out of this heap without touching the payload.
+    bool extract(void* root, std::vector<alloc_info*>& graph) {
+        adopt_pending();
+        auto itr = allocs_reg_.find(root);
+        if (itr == allocs_reg_.end()) { return false; }
+
+        std::vector<alloc_info*> stack{itr->second};
+        itr->second->tag = ETAG::USED;
+        while (!stack.empty())
+        {
+            alloc_info* alloc = stack.back();
+            stack.pop_back();
+            graph.push_back(alloc);
+            if (alloc->no_scan) { continue; }
+
+            char* begin = static_cast<char*>(alloc->addr);
+            scan_words(begin, begin + alloc->size, [this, &stack](void* val) {
+                auto child = allocs_reg_.find(val);
+                if (child == allocs_reg_.end() || child->second->tag == ETAG::USED) { return; }
+                child->second->tag = ETAG::USED;
+                stack.push_back(child->second);
             });
         }
 
-        LOG_DEBUG("%s", "All threads sleep");
+        for (auto alloc : graph)
+        {
+            alloc->tag = ETAG::NONE;
+            allocs_reg_.erase(alloc->addr);
+            cur_mem_capacity -= alloc->size;
+            live_bytes_ -= alloc->size;
+        }
+        held_.erase(root);
+        return true;
+    }
 
-        LOG_DEBUG("Tpool q_mutex = %d", (int)tpool_.check_q_mutex());
-        
-        for (auto[key, val] : reg_) {
-            LOG_DEBUG("%s", "Done 1 collect");
-            // do_collect(key);
-            tpool_.add_priority_task([val]() { val->collect(); });
+    // Takes every allocation out of this heap. Objects referenced by the roots are reported in `held`.
+    void extract_all(std::vector<alloc_info*>& graph, std::vector<void*>& held) {
+        adopt_pending();
+        for_each_root_value([this, &held](void* obj) {
+            if (allocs_reg_.contains(obj)) { held.push_back(obj); }
+        });
+        held.insert(held.end(), held_.begin(), held_.end());
+
+        for (const auto& [addr, alloc] : allocs_reg_)
+        {
+            graph.push_back(alloc);
         }
-        tpool_.wait_all();
+        allocs_reg_.clear();
+        held_.clear();
+        cur_mem_capacity = 0;
+        live_bytes_ = 0;
+    }
 
-        LOG_DEBUG("%s", "Done cleaning")
+    // Can be called from any thread.
+    void adopt(std::vector<alloc_info*>& graph, const std::vector<void*>& held) {
+        std::lock_guard inbox_lock(inbox_mtx_);
+        inbox_.insert(inbox_.end(), graph.begin(), graph.end());
+        inbox_held_.insert(inbox_held_.end(), held.begin(), held.end());
+        inbox_cnt_.fetch_add(graph.size(), std::memory_order_release);
+    }
 
-        is_global_collecting.store(false);
-        handle_cv.notify_all();
-        tpool_.unblock();
+    unsigned long long int get_roots_cnt() {
+        return roots_.size();
+    }
+
+    unsigned long long int get_live_bytes() {
+        return live_bytes_;
+    }
+
+    void set_budget(uint64_t soft, uint64_t hard) {
+        soft_budget_ = soft;
+        hard_budget_ = hard;
+        soft_reached_ = false;
+    }
+
+    void account_alloc(uint64_t size) {
+        live_bytes_ += size;
+        process_live_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void account_free(uint64_t size) {
+        live_bytes_ -= size;
+        process_live_bytes.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    // Runs the implicit collections due before an allocation of `size` bytes and checks the budgets.
+    EERROR prepare_alloc(size_t size) {
+        bool collected = false;
+        if (cur_mem_capacity >= sweep_factor)
+        {
+            // Work already done by a budgeted cycle is not thrown away.
+            TRACE_BEGIN(BACKGROUND_COLLECT, this);
+            if (cycle_ != ECYCLE::IDLE)
+            {
+                collect_step(0);
+            } else
+            {
+                collect();
+            }
+            TRACE_END(BACKGROUND_COLLECT, this);
+            collected = true;
+            sweep_factor.store(TriggerPolicy::next(sweep_factor.load(), cur_mem_capacity.load(), live_bytes_));
+        }
+
+        // A soft budget triggers one early collection, and is armed again once the heap gets below it.
+        if (soft_budget_ != 0 && live_bytes_ + size > soft_budget_)
+        {
+            if (!soft_reached_ && !collected)
+            {
+                TRACE_BEGIN(BACKGROUND_COLLECT, this);
+                collect();
+                TRACE_END(BACKGROUND_COLLECT, this);
+                collected = true;
+            }
+            soft_reached_ = live_bytes_ + size > soft_budget_;
+        } else
+        {
+            soft_reached_ = false;
+        }
+
+        if (hard_budget_ != 0 && live_bytes_ + size > hard_budget_)
+        {
+            if (!collected) { collect(); }
+            if (live_bytes_ + size > hard_budget_) { return EERROR::BUDGET; }
+        }
+
+        uint64_t process_bytes = process_live_bytes.load(std::memory_order_relaxed) + size;
+        uint64_t process_hard = process_hard_budget.load(std::memory_order_relaxed);
+        if (process_hard != 0 && process_bytes > process_hard) { return EERROR::PROCESS_BUDGET; }
+
+        uint64_t process_soft = process_soft_budget.load(std::memory_order_relaxed);
+        if (process_soft != 0 && process_bytes > process_soft)
+        {
+            if (!process_soft_reached.exchange(true)) { return EERROR::PROCESS_SOFT; }
+        } else if (process_soft_reached.load(std::memory_order_relaxed))
+        {
+            process_soft_reached.store(false);
+        }
+        return EERROR::NONE;
+    }
+
+    // With ALLOC_ZEROED the block comes from calloc, which skips clearing memory fresh from the kernel.
+    void gc_malloc(size_t size, void*& res, EERROR& error, alloc_site* site = NULL, uint32_t flags = 0) {
+        adopt_pending();
+        if ((flags & ALLOC_COUNTED) && zct_.size() >= zct_limit_) { process_zct(); }
+        error = prepare_alloc(size);
+        if (error == EERROR::BUDGET || error == EERROR::PROCESS_BUDGET)
+        {
+            res = NULL;
+            return;
+        }
+        
+        if (!regions_.empty())
+        {
+            // Region memory is fresh or decommitted, so it is zeroed already.
+            res = regions_.back()->allocate(size);
+            if (site != NULL) { profiler_release(site, size); }
+            if (res == NULL)
+            {
+                error = EERROR::NOMEM;
+                return;
+            }
+            account_alloc(size);
+            LOG_DEBUG("Region malloc at %p size of %lu", res, size);
+            return;
+        }
+
+        res = (flags & ALLOC_ZEROED) ? AllocatorPolicy::allocate_zeroed(size) : AllocatorPolicy::allocate(size);
+
+        if (res == NULL && size != 0)
+        {
+            error = EERROR::NOMEM;
+            return;
+        }
+        register_block(res, size, site, flags);
+    }
+
+    // Keeps a block the caller has not stored to a root yet alive over a collection the manager runs for it.
+    void hold(void* addr) {
+        held_.insert(addr);
+    }
+
+    void unhold(void* addr) {
+        held_.erase(addr);
+    }
+
+    void register_block(void* res, size_t size, alloc_site* site, uint32_t flags = 0) {
+        alloc_info* allocation = new alloc_info;
+        allocation->addr = res;
+        allocation->size = size;
+        allocation->tag = ETAG::NONE;
+        allocation->has_weak = false;
+        allocation->no_scan = (flags & ALLOC_NO_SCAN) != 0;
+        allocation->site = site;
+        allocation->epoch = 0;
+        allocation->scan_hash = 0;
+        allocation->serial = next_serial();
+        allocation->counted = (flags & ALLOC_COUNTED) != 0;
+        allocation->in_zct = false;
+        allocation->rc = 0;
+        if (cycle_ != ECYCLE::IDLE) { shade_new(allocation); }
+        // A new counted object is referenced only by the variable it was stored to
+        if (allocation->counted) { queue_zero(allocation); }
+
+        index_block(allocation);
+        cur_mem_capacity += size;
+        allocated_since_collect_.fetch_add(size, std::memory_order_relaxed);
+        account_alloc(size);
+        TRACE_OBJECT(MALLOC, res);
+        LOG_DEBUG("Malloc at %p size of %lu", res, size);
+    }
+
+    // Resizes the allocation at `addr` in place of malloc + memcpy + garbage. libc realloc already
+    // extends into the free neighbouring chunk and uses mremap for mmap-ed blocks, so only the
+    // registry entry is rekeyed when the block moves. On failure `res` keeps the old block, and is NULL
+    // for a block the heap does not own.
+    void gc_realloc(void* addr, size_t size, void*& res, EERROR& error, alloc_site* site = NULL) {
+        if (addr == NULL)
+        {
+            gc_malloc(size, res, error, site);
+            return;
+        }
+
+        adopt_pending();
+        res = addr;
+        error = EERROR::NONE;
+        auto itr = allocs_reg_.find(addr);
+        if (itr == allocs_reg_.end())
+        {
+            region_realloc(addr, size, res, error);
+            return;
+        }
+
+        alloc_info* allocation = itr->second;
+        size_t old_size = allocation->size;
+        if (size > old_size)
+        {
+            // The block may be referenced only by the caller's stack, which is not scanned.
+            bool held = held_.insert(addr).second;
+            error = prepare_alloc(size - old_size);
+            if (held) { held_.erase(addr); }
+            if (error == EERROR::BUDGET || error == EERROR::PROCESS_BUDGET) { return; }
+        }
+
+        void* mem = AllocatorPolicy::reallocate(addr, old_size, size > 0 ? size : 1);
+        if (mem == NULL)
+        {
+            error = EERROR::NOMEM;
+            return;
+        }
+
+        if (mem != addr)
+        {
+            allocs_reg_.erase(itr);
+            allocation->addr = mem;
+            index_block(allocation);
+            if (allocation->in_zct) { zct_.push_back(mem); }
+            // grey_ and marked_ hold the old address, so a block marked by the running cycle is scanned
+            // and checked by the remark again under the new one
+            if ((cycle_ == ECYCLE::MARK || cycle_ == ECYCLE::REMARK) && allocation->epoch == epoch_)
+            {
+                allocation->scan_hash = 0;
+                grey_.push_back(mem);
+                if (!allocation->no_scan) { marked_.push_back(mem); }
+            }
+            if (allocation->has_weak)
+            {
+                for (auto ref : weak_refs_)
+                {
+                    if (ref->target == addr) { ref->target = mem; }
+                }
+            }
+        }
+
+        if (allocation->site != NULL)
+        {
+            profiler_resize(allocation->site, old_size, size);
+        }
+        allocation->size = size;
+        cur_mem_capacity = cur_mem_capacity - old_size + size;
+        account_free(old_size);
+        account_alloc(size);
+        res = mem;
+        LOG_DEBUG("Realloc %p to %p size of %lu", addr, mem, size);
+    }
+
+    region_arena* find_region(void* addr) {
+        for (auto itr = regions_.rbegin(); itr != regions_.rend(); ++itr)
+        {
+            if ((*itr)->contains(addr)) { return *itr; }
+        }
+        return NULL;
+    }
+
+    // Region objects cannot grow in place, the copy is made in the region that owns the old one.
+    void region_realloc(void* addr, size_t size, void*& res, EERROR& error) {
+        region_arena* region = find_region(addr);
+        if (region == NULL)
+        {
+            res = NULL;
+            error = EERROR::INVAL;
+            return;
+        }
+
+        size_t old_size = region->size_of(addr);
+        if (size <= old_size) { return; }
+
+        error = prepare_alloc(size);
+        if (error == EERROR::BUDGET || error == EERROR::PROCESS_BUDGET) { return; }
+
+        void* mem = region->allocate(size);
+        if (mem == NULL)
+        {
+            error = EERROR::NOMEM;
+            return;
+        }
+        memcpy(mem, addr, old_size);
+        account_alloc(size);
+        res = mem;
+    }
+
+    void region_begin() {
+        adopt_pending();
+        region_arena* region = spare_region_ != NULL ? spare_region_ : new region_arena(node_, huge_pages_);
+        spare_region_ = NULL;
+        regions_.push_back(region);
+    }
+
+    // Releases the innermost region wholesale, without marking.
+    bool region_end() {
+        if (regions_.empty()) { return false; }
+
+        region_arena* region = regions_.back();
+        regions_.pop_back();
+        account_free(region->bytes());
+        region->reset();
+
+        delete spare_region_;
+        spare_region_ = region;
+        return true;
+    }
+
+    // Copies a region object into the heap, so that it outlives the region. The copy is shallow.
+    bool region_promote(void* addr, void*& res, EERROR& error) {
+        res = NULL;
+        error = EERROR::NONE;
+        region_arena* region = find_region(addr);
+        if (region == NULL) { return false; }
+
+        size_t size = region->size_of(addr);
+        error = prepare_alloc(size);
+        if (error == EERROR::BUDGET || error == EERROR::PROCESS_BUDGET) { return true; }
+
+        res = AllocatorPolicy::allocate(size > 0 ? size : 1);
+        if (res == NULL)
+        {
+            error = EERROR::NOMEM;
+            return true;
+        }
+        memcpy(res, addr, size);
+        register_block(res, size, NULL);
+        return true;
+    }
+
+    void gc_malloc_movable(size_t size, gc_handle& res, EERROR& error) {
+        adopt_pending();
+        error = prepare_alloc(size);
+        if (error == EERROR::BUDGET || error == EERROR::PROCESS_BUDGET)
+        {
+            res = NULL;
+            return;
+        }
+
+        res = movable_.allocate(size);
+        if (res == NULL)
+        {
+            error = EERROR::NOMEM;
+            return;
+        }
+
+        cur_mem_capacity += size;
+        account_alloc(size);
+        TRACE_OBJECT(MALLOC, res->addr);
+        LOG_DEBUG("Movable malloc at %p size of %lu", res->addr, size);
+    }
+
+    void gc_free(void* addr) {
+        adopt_pending();
+        auto itr = allocs_reg_.find(addr);
+        if (itr == allocs_reg_.end())
+        {
+            gc_handle_entry* entry = movable_.find_handle(addr);
+            if (entry == NULL) { return; }
+
+            LOG_DEBUG("Free movable %p", entry->addr);
+            TRACE_OBJECT(FREE, entry->addr);
+            cur_mem_capacity -= entry->size;
+            account_free(entry->size);
+            movable_.release(entry);
+            return;
+        }
+        
+        LOG_DEBUG("Free %p", addr);
+        TRACE_OBJECT(FREE, addr);
+        if (itr->second->counted) { release_children(itr->second); }
+        cur_mem_capacity -= itr->second->size;
+        account_free(itr->second->size);
+
+        if (itr->second->site != NULL)
+        {
+            profiler_release(itr->second->site, itr->second->size);
+        }
+
+        if (itr->second->has_weak)
+        {
+            for (auto ref : weak_refs_)
+            {
+                if (ref->target == addr) { ref->target = NULL; }
+            }
+        }
+
+        AllocatorPolicy::release(addr, itr->second->size);
+        delete itr->second;
+        allocs_reg_.erase(itr);
+    }
+
+    void mark_root(void* addr) {
+        roots_.insert(addr);
+    }
+
+    void set_root_list(gc_root_node* head) {
+        root_list_ = head;
+    }
+
+    void unmark_root(void* addr) {
+        if (!roots_.contains(addr)) { return; }
+        
+        roots_.erase(addr);
+    }
+
+    // Counts a reference to a counted object stored in GC memory. Other addresses are ignored.
+    void retain(void* addr) {
+        adopt_pending();
+        auto itr = allocs_reg_.find(addr);
+        if (itr == allocs_reg_.end() || !itr->second->counted) { return; }
+        ++itr->second->rc;
+    }
+
+    void release(void* addr) {
+        adopt_pending();
+        auto itr = allocs_reg_.find(addr);
+        if (itr == allocs_reg_.end() || !itr->second->counted || itr->second->rc == 0) { return; }
+        if (--itr->second->rc == 0) { queue_zero(itr->second); }
+        if (zct_.size() >= zct_limit_) { process_zct(); }
+    }
+
+    // Frees the objects of the zero count table that no root refers to, and those whose count drops to 0
+    // as a result, without tracing. Objects held by roots stay in the table for the next batch. Cycles
+    // never reach a zero count and are left to mark-sweep. Returns the number of freed objects.
+    size_t process_zct() {
+        adopt_pending();
+        if (zct_.empty()) { return 0; }
+
+        std::unordered_set<void*> rooted;
+        for_each_root_value([&rooted](void* val) { rooted.insert(val); });
+        for_each_data_value(false, [&rooted](void* val) { rooted.insert(val); });
+        rooted.insert(held_.begin(), held_.end());
+
+        std::vector<void*> kept;
+        size_t freed = 0;
+        while (!zct_.empty())
+        {
+            void* addr = zct_.back();
+            zct_.pop_back();
+            auto itr = allocs_reg_.find(addr);
+            // Entries of objects freed or moved since they were queued are stale
+            if (itr == allocs_reg_.end() || !itr->second->in_zct) { continue; }
+
+            alloc_info* alloc = itr->second;
+            alloc->in_zct = false;
+            if (alloc->rc != 0) { continue; }
+            if (rooted.contains(addr))
+            {
+                alloc->in_zct = true;
+                kept.push_back(addr);
+                continue;
+            }
+            gc_free(addr);
+            ++freed;
+        }
+        zct_.swap(kept);
+        // Objects held by roots are not rechecked more often than the table grows
+        zct_limit_ = std::max<size_t>(ZCT_BATCH, zct_.size() * 2);
+        LOG_DEBUG("Zero count table freed %lu, kept %lu", freed, zct_.size());
+        return freed;
+    }
+
+    gc_weak_ref* weak_create(void* addr) {
+        auto itr = allocs_reg_.find(addr);
+        if (itr == allocs_reg_.end()) { return NULL; }
+
+        gc_weak_ref* ref = new gc_weak_ref;
+        ref->target = addr;
+        itr->second->has_weak = true;
+        weak_refs_.insert(ref);
+        return ref;
+    }
+
+    void* weak_get(gc_weak_ref* ref) {
+        if (!weak_refs_.contains(ref)) { return NULL; }
+        return ref->target;
+    }
+
+    void weak_destroy(gc_weak_ref* ref) {
+        if (weak_refs_.erase(ref) == 0) { return; }
+        delete ref;
+    }
+
+    void pin(gc_handle handle) {
+        gc_handle_entry* entry = movable_.find_handle(handle);
+        if (entry == NULL) { return; }
+        movable_.pin(entry);
+    }
+
+    void unpin(gc_handle handle) {
+        gc_handle_entry* entry = movable_.find_handle(handle);
+        if (entry == NULL) { return; }
+        movable_.unpin(entry);
+    }
+
+    // Movable objects are compacted only by a global collection: it is the one that stops every thread
+    // and knows where their stacks end. A global collection reports the profile once for all heaps.
+    // Collections that run while the owner is stopped by SIGUSR1 pass `stopped`.
+    void collect(bool compact = false, bool report = true, bool stopped = false) {
+        latency_part collecting(GC_LATENCY_COLLECT);
+        adopt_pending();
+        abort_cycle();
+        allocated_since_collect_.store(0, std::memory_order_relaxed);
+        TRACE_BEGIN(COLLECT, this);
+        mark(compact, stopped);
+        sweep();
+        account_free(movable_.sweep(compact));
+        publish_census();
+        TRACE_END(COLLECT, this);
+        if (report) { profiler_report(); }
+    }
+
+    // Incremented by the manager on every operation on this heap, the background collector compares it between ticks.
+    std::atomic<uint64_t> ops = 0;
+
+    void set_background(bool background) {
+        background_ = background;
+    }
+
+    bool is_background() {
+        return background_;
+    }
+
+    // Called by the background collector thread only. A heap is due when it has allocated since its last
+    // collection and either is close to its allocation trigger or its owner did nothing since the last tick.
+    bool background_due() {
+        uint64_t ops_now = ops.load(std::memory_order_relaxed);
+        bool idle = ops_now == background_ops_seen_;
+        background_ops_seen_ = ops_now;
+
+        if (allocated_since_collect_.load(std::memory_order_relaxed) == 0) { return false; }
+        bool near_trigger = cur_mem_capacity.load(std::memory_order_relaxed) >=
+                            sweep_factor.load(std::memory_order_relaxed) / 4 * 3;
+        return idle || near_trigger;
+    }
+
+    // Runs the budgeted cycle until it finishes or `deadline` (CLOCK_MONOTONIC ns, 0 for none) passes.
+    // Marking, the remark and sweeping are split into slices. Movable objects are
+    // only kept alive here, the compacting space is reclaimed by full collections.
+    bool collect_step(uint64_t deadline) {
+        latency_part collecting(GC_LATENCY_COLLECT);
+        adopt_pending();
+        TRACE_BEGIN(COLLECT, this);
+        if (cycle_ == ECYCLE::IDLE)
+        {
+            if (++epoch_ == 0) { ++epoch_; }
+            cycle_ = ECYCLE::MARK;
+            // Tracking starts before anything is scanned, so every later write is seen by the remark
+            dirty_tracked_ = dirty_pages_ && dirty_begin();
+            shade_roots();
+            // Clearing the soft-dirty bits costs time proportional to the resident set. It is counted
+            // against this step, marking starts in the next one if it used the budget up.
+            if (dirty_tracked_ && deadline != 0 && now_ns() >= deadline)
+            {
+                TRACE_END(COLLECT, this);
+                return false;
+            }
+        }
+
+        if (cycle_ == ECYCLE::MARK)
+        {
+            if (!drain_grey(deadline))
+            {
+                TRACE_END(COLLECT, this);
+                return false;
+            }
+            remark_passes_ = 0;
+            cycle_ = ECYCLE::REMARK;
+        }
+
+        if (cycle_ == ECYCLE::REMARK)
+        {
+            if (!remark(deadline))
+            {
+                TRACE_END(COLLECT, this);
+                return false;
+            }
+            marked_.clear();
+
+            sweep_list_.clear();
+            sweep_list_.reserve(allocs_reg_.size());
+            for (const auto& [addr, alloc] : allocs_reg_)
+            {
+                sweep_list_.push_back(addr);
+            }
+            sweep_pos_ = 0;
+            census_next_ = {};
+            cycle_ = ECYCLE::SWEEP;
+        }
+
+        bool done = sweep_slice(deadline);
+        if (done)
+        {
+            movable_.clear_marks();
+            sweep_list_.clear();
+            cycle_ = ECYCLE::IDLE;
+            publish_census();
+        }
+        TRACE_END(COLLECT, this);
+        if (done) { profiler_report(); }
+        return done;
+    }
+
+    // Must be called by the thread that owns the heap.
+    basic_gc() {
+        cur_mem_capacity = 0;
+        sweep_factor = TriggerPolicy::initial;
+        if constexpr (IndexPolicy::reserve > 0) { allocs_reg_.reserve(IndexPolicy::reserve); }
+        bind_to_thread();
+    }
+
+    // Fills in what depends on the owner thread. Must be called by the thread that owns the heap.
+    void bind_to_thread() {
+        node_ = numa_current_node();
+        movable_.set_node(node_);
+        if (spare_region_ != NULL) { spare_region_->set_node(node_); }
+
+        stack_hi_ = NULL;
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0)
+        {
+            void* stack_addr;
+            size_t stack_size;
+            if (pthread_attr_getstack(&attr, &stack_addr, &stack_size) == 0)
+            {
+                stack_hi_ = static_cast<char*>(stack_addr) + stack_size;
+            }
+            pthread_attr_destroy(&attr);
+        }
+    }
+
+    // Frees everything the heap holds and resets it to the state of a new one. The hash tables keep
+    // their buckets and the arenas their first chunk, so the next owner does not rehash or map memory
+    // while the heap grows back.
+    void recycle() {
+        release_all();
+        if (allocs_reg_.bucket_count() > RETIRED_BUCKETS_MAX)
+        {
+            decltype(allocs_reg_)().swap(allocs_reg_);
+            if constexpr (IndexPolicy::reserve > 0) { allocs_reg_.reserve(IndexPolicy::reserve); }
+        }
+
+        root_list_ = NULL;
+        cur_mem_capacity = 0;
+        sweep_factor = TriggerPolicy::initial;
+        allocated_since_collect_ = 0;
+        background_ops_seen_ = 0;
+        background_ = false;
+        set_huge_pages(false);
+        dirty_pages_ = false;
+        scan_data_ = false;
+        blocks_lo_ = UINTPTR_MAX;
+        blocks_hi_ = 0;
+        collections_ = 0;
+        {
+            std::lock_guard census_lock(census_mtx_);
+            census_ = {};
+        }
+        set_budget(0, 0);
+        adopt_on_stop_ = false;
+        stopped_sp.store(NULL);
+        ops.store(0);
+    }
+
+    ~basic_gc() {
+        release_all();
+        delete spare_region_;
+    }
+private:
+    void release_all() {
+        abort_cycle();
+        for (const auto& alloc : allocs_reg_) {
+            if (alloc.second->site != NULL) { profiler_release(alloc.second->site, alloc.second->size); }
+            AllocatorPolicy::release(alloc.first, alloc.second->size);
+            delete alloc.second;
+        }
+        allocs_reg_.clear();
+        for (auto ref : weak_refs_) {
+            delete ref;
+        }
+        weak_refs_.clear();
+        {
+            std::lock_guard inbox_lock(inbox_mtx_);
+            for (auto alloc : inbox_) {
+                if (alloc->site != NULL) { profiler_release(alloc->site, alloc->size); }
+                live_bytes_ += alloc->size;
+                AllocatorPolicy::release(alloc->addr, alloc->size);
+                delete alloc;
+            }
+            inbox_.clear();
+            inbox_held_.clear();
+            inbox_cnt_.store(0);
+        }
+        {
+            std::lock_guard lazy_lock(lazy_mtx_);
+            lazy_free_.clear();
+            lazy_cnt_.store(0);
+        }
+        while (region_end()) {}
+        movable_.clear_marks();
+        movable_.sweep(false);
+        account_free(live_bytes_);
+
+        roots_.clear();
+        held_.clear();
+        zct_.clear();
+        zct_limit_ = ZCT_BATCH;
+    }
+};
+
+using gc = basic_gc<GC_CONFIG::allocator, GC_CONFIG::index, GC_CONFIG::scan, GC_CONFIG::trigger>;
+
+static void stop_on_thread_exit(void*) {
+    gc_stop(pthread_self());
+}
+
+class gc_manager
+{
+private:
+    std::mutex global_run_mtx;
+    std::mutex reg_mtx_;
+    std::unordered_map<pthread_t, gc*> reg_;
+    // Heaps of the running global operation, copied from reg_ by stop_world. Threads registered later keep
+    // running and their heaps are skipped. erase_from_reg takes global_run_mtx, so none of these is deleted.
+    std::vector<std::pair<pthread_t, gc*>> world_;
+    thread_pool tpool_;
+    size_t gc_cnt;
+
+    std::thread background_thread_;
+    std::mutex background_mtx_;
+    std::condition_variable background_cv_;
+    bool background_running_ = false;
+    std::atomic<bool> background_collecting_ = false;     // is_global_collecting is held by background_run
+
+    // Heaps of stopped threads, reused by gc_create_ex instead of building new ones.
+    std::mutex retired_mtx_;
+    std::vector<gc*> retired_;
+
+    // Its destructor stops the heap of a thread that exits without gc_stop.
+    pthread_key_t exit_key_;
+
+    // At most one snapshot collection is in flight, its reader thread outlives the call that started it.
+    std::atomic<bool> snapshot_running_ = false;
+    std::thread snapshot_reader_;
+
+    // Memory pressure monitor, see gc_pressure_start.
+    std::thread pressure_thread_;
+    std::mutex pressure_mtx_;
+    std::condition_variable pressure_cv_;
+    bool pressure_running_ = false;
+    std::string pressure_psi_;
+    std::string pressure_cgroup_;
+    std::atomic<uint64_t> pressure_events_ = 0;
+
+    // Heap that is not bound to a thread. It keeps transferred graphs alive until some thread claims them.
+    gc* orphan_;
+    std::mutex orphan_mtx_;
+
+    gc* get_heap(pthread_t tid) {
+        if (tid == GC_ORPHAN_HEAP) { return orphan_; }
+        return get_gc(tid);
+    }
+
+    // Called from a pool task, the heir is looked up again because it may have stopped meanwhile.
+    void hand_over(pthread_t to_tid, std::vector<alloc_info*>& graph, const std::vector<void*>& held) {
+        std::lock_guard reg_lock(reg_mtx_);
+        auto itr = reg_.find(to_tid);
+        gc* to = itr != reg_.end() ? itr->second : orphan_;
+        to->adopt(graph, to == orphan_ ? held : std::vector<void*>());
+    }
+
+    gc* get_gc(pthread_t tid) {
+        std::lock_guard reg_lock(reg_mtx_);
+        if (!reg_.contains(tid))
+        {
+            LOG_CRITICAL("Thread with id: %lld does not have GC", (long long int)tid);
+            // std::exit(EXIT_FAILURE);
+            errno = EINVAL;
+            return NULL;
+        }
+        
+        gc* thread_gc = reg_[tid];
+        thread_gc->ops.fetch_add(1, std::memory_order_relaxed);
+        return thread_gc;
+    }
+
+    // Called with global_run_mtx held and the pool blocked.
+    void stop_world(pthread_t origin_tid) {
+        {
+            std::lock_guard reg_lock(reg_mtx_);
+            world_.assign(reg_.begin(), reg_.end());
+        }
+        for (const auto&[key, val] : world_) {
+            if (key == origin_tid) { continue; }
+            is_stoped.store(false);
+            pthread_kill(key, SIGUSR1);
+
+            std::unique_lock collection_lock(gr_manager_mtx);
+            gr_manager_cv.wait(collection_lock, [](){
+                return is_stoped.load();
+            });
+        }
+
+        LOG_DEBUG("%s", "All threads sleep");
+    }
+
+    // The origin thread is not stopped by the signal, so the caller spills its registers and passes its frame.
+    void record_origin_stack(pthread_t origin_tid, void* frame) {
+        for (const auto&[key, val] : world_) {
+            if (key == origin_tid) { val->stopped_sp.store(frame); }
+        }
+    }
+
+    void resume_world() {
+        for (const auto&[key, val] : world_) {
+            val->stopped_sp.store(NULL);
+        }
+
+        is_global_collecting.store(false);
+        handle_cv.notify_all();
+        tpool_.unblock();
+    }
+
+    // Takes is_global_collecting for a global operation. A running global collection or snapshot already
+    // collects every heap, so the caller has nothing to do. A background collection covers one heap only and
+    // is waited out.
+    bool begin_global() {
+        bool expected = false;
+        while (!is_global_collecting.compare_exchange_strong(expected, true))
+        {
+            if (!background_collecting_.load()) { return false; }
+
+            latency_part blocked(GC_LATENCY_BLOCKED);
+            std::unique_lock handle_lock(handle_mtx);
+            while (!handle_cv.wait_for(handle_lock, std::chrono::milliseconds(1), []() {
+                return !is_global_collecting.load();
+            })) {}
+            expected = false;
+        }
+        return true;
+    }
+
+    void global_run(pthread_t origin_tid) {
+        if (!begin_global()) { return; }
+        // Heaps are collected by priority tasks, which run outside the caller's latency scope
+        latency_part collecting(GC_LATENCY_COLLECT);
+        std::lock_guard run_lock(global_run_mtx);
+        TRACE_BEGIN(GLOBAL_RUN, origin_tid);
+        tpool_.block();
+        tpool_.wait_all();
+
+        // Stopped threads may hold the loader lock, the heaps scan the list read here
+        data_roots.refresh();
+        stop_world(origin_tid);
+        __builtin_unwind_init();
+        record_origin_stack(origin_tid, __builtin_frame_address(0));
+
+        LOG_DEBUG("Tpool q_mutex = %d", (int)tpool_.check_q_mutex());
+        
+        for (const auto&[key, val] : world_) {
+            LOG_DEBUG("%s", "Done 1 collect");
+            // do_collect(key);
+            tpool_.add_priority_task_on(val->node(), [val]() { val->collect(true, false, true); });
+        }
+        tpool_.add_priority_task([this]() {
+            std::lock_guard orphan_lock(orphan_mtx_);
+            orphan_->collect(false, false, true);
+        });
+        tpool_.wait_all();
+
+        LOG_DEBUG("%s", "Done cleaning")
+
+        resume_world();
+        TRACE_END(GLOBAL_RUN, origin_tid);
+        profiler_report();
         LOG_DEBUG("%s", "All threads are waking up")
     }
 
-    void nomem_handler(pthread_t origin_tid, gc* thread_gc, void*& dest, size_t size) {
-        if (is_global_collecting.load())
+    // Stops the world only for the fork. The child marks the copy-on-write snapshot of every heap and
+    // streams the unreachable allocations back, the heaps free them lazily while the world keeps running.
+    // The orphan heap and movable objects are left to regular collections, compaction needs the world stopped.
+    void snapshot_run(pthread_t origin_tid) {
+        bool expected = false;
+        if (!snapshot_running_.compare_exchange_strong(expected, true)) { return; }
+        if (snapshot_reader_.joinable()) { snapshot_reader_.join(); }
+
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0)
+        {
+            LOG_WARNING("%s", "Failed to create snapshot pipe, running a regular global collection");
+            snapshot_running_.store(false);
+            global_run(origin_tid);
+            return;
+        }
+
+        if (!begin_global())
+        {
+            close(fds[0]);
+            close(fds[1]);
+            snapshot_running_.store(false);
+            return;
+        }
+
+        long child;
+        {
+            std::lock_guard run_lock(global_run_mtx);
+            TRACE_BEGIN(SNAPSHOT_FORK, origin_tid);
+            tpool_.block();
+            tpool_.wait_all();
+
+            data_roots.refresh();
+            stop_world(origin_tid);
+            __builtin_unwind_init();
+            record_origin_stack(origin_tid, __builtin_frame_address(0));
+
+            // A raw clone instead of fork(): fork() runs atfork handlers and takes the malloc locks, which
+            // a stopped thread may be holding.
+            child = syscall(SYS_clone, SIGCHLD, 0, NULL, NULL, 0);
+            if (child == 0)
+            {
+                close(fds[0]);
+                snapshot_child(fds[1]);
+                _exit(0);
+            }
+
+            resume_world();
+            TRACE_END(SNAPSHOT_FORK, origin_tid);
+        }
+
+        close(fds[1]);
+        if (child < 0)
+        {
+            LOG_WARNING("%s", "Failed to fork snapshot process");
+            close(fds[0]);
+            snapshot_running_.store(false);
+            return;
+        }
+        snapshot_reader_ = std::thread(&gc_manager::snapshot_read, this, fds[0], static_cast<pid_t>(child));
+    }
+
+    // Runs in the child, where only this thread exists. Nothing here may allocate or lock.
+    void snapshot_child(int fd) {
+        snapshot_record batch[SNAPSHOT_BATCH];
+        size_t used = 0;
+
+        auto flush = [fd, &batch, &used]() {
+            const char* data = reinterpret_cast<const char*>(batch);
+            size_t left = used * sizeof(snapshot_record);
+            while (left > 0)
+            {
+                ssize_t written = write(fd, data, left);
+                if (written < 0)
+                {
+                    if (errno == EINTR) { continue; }
+                    _exit(1);
+                }
+                data += written;
+                left -= static_cast<size_t>(written);
+            }
+            used = 0;
+        };
+
+        for (const auto& [tid, heap] : world_)
+        {
+            heap->snapshot_garbage([heap, &batch, &used, &flush](void* addr, uint64_t serial) {
+                batch[used++] = snapshot_record{reinterpret_cast<uint64_t>(heap), reinterpret_cast<uint64_t>(addr), serial};
+                if (used == SNAPSHOT_BATCH) { flush(); }
+            });
+        }
+        flush();
+        close(fd);
+    }
+
+    void snapshot_read(int fd, pid_t child) {
+        std::unordered_map<gc*, std::vector<std::pair<void*, uint64_t>>> garbage;
+        snapshot_record batch[SNAPSHOT_BATCH];
+        size_t have = 0;
+        while (true)
+        {
+            ssize_t got = read(fd, reinterpret_cast<char*>(batch) + have, sizeof(batch) - have);
+            if (got < 0 && errno == EINTR) { continue; }
+            if (got <= 0) { break; }
+
+            have += static_cast<size_t>(got);
+            size_t cnt = have / sizeof(snapshot_record);
+            for (size_t i = 0; i < cnt; i++)
+            {
+                garbage[reinterpret_cast<gc*>(batch[i].heap)].push_back({reinterpret_cast<void*>(batch[i].addr), batch[i].serial});
+            }
+            have -= cnt * sizeof(snapshot_record);
+            memmove(batch, reinterpret_cast<char*>(batch) + cnt * sizeof(snapshot_record), have);
+        }
+        close(fd);
+
+        // The process may have been reaped already by a SIGCHLD handler of the application.
+        int status = 0;
+        while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            // The stream may be cut short, which only means fewer objects are freed.
+            LOG_WARNING("%s", "Snapshot process failed");
+        }
+
+        {
+            // Heaps stopped since the fork are skipped, recycled ones are guarded by the serials.
+            std::lock_guard reg_lock(reg_mtx_);
+            for (const auto& [tid, heap] : reg_)
+            {
+                auto itr = garbage.find(heap);
+                if (itr != garbage.end()) { heap->queue_lazy_free(itr->second); }
+            }
+        }
+        snapshot_running_.store(false);
+    }
+
+    // Collects a single heap off the owner's request path. The owner is stopped with SIGUSR1 like in global_run,
+    // since it would otherwise mutate the heap during marking.
+    void background_run(pthread_t tid) {
+        // Set first, so a global_run that finds is_global_collecting taken waits instead of returning
+        background_collecting_.store(true);
+        bool expected = false;
+        if (!is_global_collecting.compare_exchange_strong(expected, true))
+        {
+            background_collecting_.store(false);
+            return;
+        }
+        std::lock_guard run_lock(global_run_mtx);
+
+        // The heap cannot be erased while global_run_mtx is held, see erase_from_reg.
+        gc* thread_gc = NULL;
+        {
+            std::lock_guard reg_lock(reg_mtx_);
+            auto itr = reg_.find(tid);
+            if (itr != reg_.end()) { thread_gc = itr->second; }
+        }
+
+        if (thread_gc != NULL)
+        {
+            tpool_.block();
+            tpool_.wait_all();
+
+            // The stopped owner may hold the loader lock, its heap scans the list read here
+            data_roots.refresh();
+
+            is_stoped.store(false);
+            if (pthread_kill(tid, SIGUSR1) == 0)
+            {
+                std::unique_lock collection_lock(gr_manager_mtx);
+                while (!gr_manager_cv.wait_for(collection_lock, std::chrono::milliseconds(1), []() {
+                    return is_stoped.load();
+                })) {}
+
+                TRACE_BEGIN(BACKGROUND_COLLECT, thread_gc);
+                auto task_id = tpool_.add_priority_task_on(thread_gc->node(), [thread_gc]() { thread_gc->collect(false, true, true); });
+                tpool_.wait(task_id);
+                TRACE_END(BACKGROUND_COLLECT, thread_gc);
+                thread_gc->stopped_sp.store(NULL);
+            }
+        }
+
+        is_global_collecting.store(false);
+        background_collecting_.store(false);
+        handle_cv.notify_all();
+        tpool_.unblock();
+    }
+
+    void background_loop() {
+        std::unique_lock background_lock(background_mtx_);
+        while (background_running_)
+        {
+            background_cv_.wait_for(background_lock, std::chrono::milliseconds(BACKGROUND_PERIOD_MS));
+            if (!background_running_) { break; }
+            background_lock.unlock();
+
+            std::vector<pthread_t> due;
+            {
+                std::lock_guard reg_lock(reg_mtx_);
+                for (const auto& [tid, thread_gc] : reg_)
+                {
+                    if (thread_gc->is_background() && thread_gc->background_due()) { due.push_back(tid); }
+                }
+            }
+            for (auto tid : due)
+            {
+                background_run(tid);
+            }
+
+            background_lock.lock();
+        }
+    }
+
+    void pressure_loop() {
+        pressure_source psi(pressure_psi_);
+        uint64_t relieved_ns = 0;
+
+        std::unique_lock pressure_lock(pressure_mtx_);
+        while (pressure_running_)
+        {
+            bool pressure = false;
+            if (psi.triggered())
+            {
+                pressure_lock.unlock();
+                pressure = psi.wait(PRESSURE_PERIOD_MS);
+                pressure_lock.lock();
+            } else
+            {
+                pressure_cv_.wait_for(pressure_lock, std::chrono::milliseconds(PRESSURE_PERIOD_MS));
+            }
+            if (!pressure_running_) { break; }
+            pressure_lock.unlock();
+
+            pressure = pressure || (!psi.triggered() && psi.above_average()) || pressure_cgroup_near_limit(pressure_cgroup_);
+            uint64_t now = now_ns();
+            if (pressure && now - relieved_ns >= PRESSURE_COOLDOWN_MS * 1000000ull)
+            {
+                relieve_pressure();
+                relieved_ns = now_ns();
+            }
+
+            pressure_lock.lock();
+        }
+    }
+
+    // Collects every heap, then gives free memory back to the kernel: free malloc chunks, and the arenas
+    // cached by retired heaps.
+    void relieve_pressure() {
+        LOG_INFO("%s", "Memory pressure, running a global collection");
+        global_run(pthread_self());
+        {
+            std::lock_guard retired_lock(retired_mtx_);
+            for (auto heap : retired_)
+            {
+                delete heap;
+            }
+            retired_.clear();
+        }
+        malloc_trim(0);
+        pressure_events_.fetch_add(1);
+    }
+
+    void nomem_handler(pthread_t origin_tid, gc* thread_gc, void*& dest, size_t size, alloc_site* site, uint32_t flags) {
+        if (is_global_collecting.load())
+        {
+            latency_part blocked(GC_LATENCY_BLOCKED);
+            std::unique_lock handle_lock(handle_mtx);
+            handle_cv.wait(handle_lock, []() -> bool {
+                return !is_global_collecting.load();
+            });       
+        } else
+        {
+            global_run(origin_tid);
+        }
+        
+        EERROR error;
+        auto task_id = tpool_.add_task([thread_gc, site, flags](size_t size, void*& res, EERROR& err) -> void {
+                                            thread_gc->gc_malloc(size, res, err, site, flags); 
+                                        },
+                                        size,
+                                        std::ref(dest),
+                                        std::ref(error));
+        tpool_.wait(task_id);
+
+        if (error != EERROR::NONE && error != EERROR::PROCESS_SOFT)
+        {
+            if (site != NULL) { profiler_release(site, size); }
+            report_alloc_error(error);
+        }
+    }
+
+    // The process soft budget asks for one global collection. The block just allocated is referenced only by
+    // the caller's variable, so its heap holds it until the collection is over.
+    void soft_budget_run(pthread_t origin_tid, gc* thread_gc, void* block) {
+        global_run(origin_tid);
+        if (block == NULL) { return; }
+
+        auto task_id = tpool_.add_task([thread_gc, block]() { thread_gc->unhold(block); });
+        tpool_.wait(task_id);
+    }
+
+    void report_alloc_error(EERROR error) {
+        if (error == EERROR::NOMEM)
+        {
+            LOG_CRITICAL("%s", "Heap overflow");
+            // std::exit(EXIT_FAILURE);
+            errno = ENOMEM;
+        } else if (error == EERROR::BUDGET || error == EERROR::PROCESS_BUDGET)
+        {
+            LOG_WARNING("%s", "Memory budget exceeded");
+            errno = GC_EBUDGET;
+        } else if (error == EERROR::INVAL)
+        {
+            LOG_WARNING("%s", "Realloc of a block the heap does not own");
+            errno = EINVAL;
+        }
+    }
+public:
+    gc_manager() {
+        gc_cnt = 0;
+        orphan_ = new gc;
+        if (pthread_key_create(&exit_key_, stop_on_thread_exit) != 0)
+        {
+            LOG_CRITICAL("%s", "Failed to create thread exit key, heaps have to be stopped explicitly");
+        }
+    }
+
+    ~gc_manager() {
+        pressure_stop();
+        {
+            std::lock_guard background_lock(background_mtx_);
+            background_running_ = false;
+        }
+        background_cv_.notify_all();
+        if (background_thread_.joinable())
+        {
+            background_thread_.join();
+        }
+        if (snapshot_reader_.joinable())
+        {
+            snapshot_reader_.join();
+        }
+        delete orphan_;
+        for (auto heap : retired_)
+        {
+            delete heap;
+        }
+    }
+
+    bool pressure_start(const char* psi_path, const char* cgroup_dir) {
+        std::lock_guard pressure_lock(pressure_mtx_);
+        if (pressure_running_)
+        {
+            errno = EBUSY;
+            return false;
+        }
+        pressure_psi_ = psi_path != NULL ? psi_path : "/proc/pressure/memory";
+        pressure_cgroup_ = cgroup_dir != NULL ? cgroup_dir : pressure_cgroup_dir();
+        pressure_running_ = true;
+        pressure_thread_ = std::thread(&gc_manager::pressure_loop, this);
+        return true;
+    }
+
+    void pressure_stop() {
+        {
+            std::lock_guard pressure_lock(pressure_mtx_);
+            pressure_running_ = false;
+        }
+        pressure_cv_.notify_all();
+        if (pressure_thread_.joinable())
+        {
+            pressure_thread_.join();
+        }
+    }
+
+    unsigned long long int get_pressure_events() {
+        return pressure_events_.load();
+    }
+
+    // Must be called by the thread that is going to own the heap.
+    gc* new_heap() {
+        gc* heap = NULL;
+        {
+            std::lock_guard retired_lock(retired_mtx_);
+            if (!retired_.empty())
+            {
+                heap = retired_.back();
+                retired_.pop_back();
+            }
+        }
+        if (heap == NULL) { return new gc; }
+
+        heap->bind_to_thread();
+        return heap;
+    }
+
+    void retire(gc* heap) {
+        heap->recycle();
+        {
+            std::lock_guard retired_lock(retired_mtx_);
+            if (retired_.size() < RETIRED_HEAPS_MAX)
+            {
+                retired_.push_back(heap);
+                return;
+            }
+        }
+        delete heap;
+    }
+
+    // Only the calling thread can be watched, a heap created for another thread has to be stopped explicitly.
+    void watch_thread_exit(bool watch) {
+        pthread_setspecific(exit_key_, watch ? this : NULL);
+    }
+
+    void add_to_reg(pthread_t tid, gc* new_gc) {
+        {
+            std::lock_guard reg_lock(reg_mtx_);
+            reg_.insert({tid, new_gc});
+            ++gc_cnt;
+            
+            if (tpool_.get_threads_n() < gc_cnt)
+            {
+                tpool_.add_thread();
+                LOG_DEBUG("%s", "Added 1 thread to thread pool");
+            }
+        }
+
+        if (new_gc->is_background())
+        {
+            std::lock_guard background_lock(background_mtx_);
+            if (!background_running_)
+            {
+                background_running_ = true;
+                background_thread_ = std::thread(&gc_manager::background_loop, this);
+            }
+        }
+    }
+
+    bool contains(pthread_t tid) {
+        std::lock_guard reg_lock(reg_mtx_);
+        return reg_.contains(tid);
+    }
+
+    void erase_from_reg(pthread_t tid) {
+        gc* thread_gc;
+        {
+            // Excludes background_run, which uses the heap after looking it up.
+            std::lock_guard run_lock(global_run_mtx);
+            std::lock_guard reg_lock(reg_mtx_);
+            auto itr = reg_.find(tid);
+            if (itr == reg_.end()) return;
+            thread_gc = itr->second;
+            reg_.erase(itr);
+            --gc_cnt;
+        }
+
+        pthread_t heir;
+        if (thread_gc->get_heir(heir))
+        {
+            auto task_id = tpool_.add_task([this, thread_gc, heir]() {
+                std::vector<alloc_info*> graph;
+                std::vector<void*> held;
+                thread_gc->extract_all(graph, held);
+                hand_over(heir, graph, held);
+            });
+            tpool_.wait(task_id);
+        }
+        retire(thread_gc);
+    }
+
+    // Objects are taken from the caller's own heap or from the orphan heap, whose tasks hold orphan_mtx_.
+    // Nothing orders a task against the running tasks of another thread's heap.
+    long long int do_transfer(pthread_t from_tid, pthread_t to_tid, void* root) {
+        if (from_tid != GC_ORPHAN_HEAP && !pthread_equal(from_tid, pthread_self()))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        gc* from = get_heap(from_tid);
+        if (from == NULL || get_heap(to_tid) == NULL) { return -1; }
+
+        bool found = false;
+        long long int moved = 0;
+        auto task_id = tpool_.add_task([this, from, to_tid, root, &found, &moved]() {
+            std::unique_lock orphan_lock(orphan_mtx_, std::defer_lock);
+            if (from == orphan_) { orphan_lock.lock(); }
+
+            std::vector<alloc_info*> graph;
+            found = from->extract(root, graph);
+            if (!found) { return; }
+
+            moved = static_cast<long long int>(graph.size());
+            hand_over(to_tid, graph, std::vector<void*>{root});
+        });
+        tpool_.wait(task_id);
+
+        if (!found)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        return moved;
+    }
+
+    bool region_begin(pthread_t tid) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return false; }
+
+        auto task_id = tpool_.add_task([thread_gc]() { thread_gc->region_begin(); });
+        tpool_.wait(task_id);
+        return true;
+    }
+
+    bool region_end(pthread_t tid) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return false; }
+
+        bool closed = false;
+        auto task_id = tpool_.add_task([thread_gc, &closed]() { closed = thread_gc->region_end(); });
+        tpool_.wait(task_id);
+
+        if (!closed)
+        {
+            errno = EINVAL;
+            return false;
+        }
+        return true;
+    }
+
+    void* region_promote(pthread_t tid, void* addr) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return NULL; }
+
+        void* res = NULL;
+        EERROR error;
+        bool found = false;
+        auto promote = [this, thread_gc, addr, &res, &error, &found]() {
+            auto task_id = tpool_.add_task([thread_gc, addr, &res, &error, &found]() {
+                found = thread_gc->region_promote(addr, res, error);
+                if (error == EERROR::PROCESS_SOFT && res != NULL) { thread_gc->hold(res); }
+            });
+            tpool_.wait(task_id);
+        };
+        promote();
+
+        if (!found)
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+        if (error == EERROR::PROCESS_SOFT)
+        {
+            soft_budget_run(tid, thread_gc, res);
+        } else if (error == EERROR::NOMEM || error == EERROR::PROCESS_BUDGET)
+        {
+            global_run(tid);
+            promote();
+        }
+        report_alloc_error(error);
+        return res;
+    }
+
+    // Returns 1 when the cycle finished, 0 when it has to be continued by another call.
+    int do_collect_budget(pthread_t tid, int flag, uint64_t max_ns) {
+        if (flag == GLOBAL)
         {
-            std::unique_lock handle_lock(handle_mtx);
-            handle_cv.wait(handle_lock, []() -> bool {
-                return !is_global_collecting.load();
-            });       
-        } else
+            global_run(tid);
+            return 1;
+        } else if (flag != THREAD_LOCAL)
         {
-            global_run(origin_tid);
+            errno = EINVAL;
+            return -1;
         }
-        
-        EERROR error;
-        auto task_id = tpool_.add_task([thread_gc](size_t size, void*& res, EERROR& err) -> void {
-                                            thread_gc->gc_malloc(size, res, err); 
-                                        },
-                                        size,
-                                        std::ref(dest),
-                                        std::ref(error));
+
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return -1; }
+
+        bool done = false;
+        auto task_id = tpool_.add_task_on(thread_gc->node(), [thread_gc, max_ns, &done]() {
+            done = thread_gc->collect_step(now_ns() + std::max<uint64_t>(max_ns, 1));
+        });
         tpool_.wait(task_id);
+        return done ? 1 : 0;
+    }
 
-        if (error == EERROR::NOMEM)
+    void set_root_list(pthread_t tid, gc_root_node* head) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return; }
+
+        auto task_id = tpool_.add_task([thread_gc, head]() { thread_gc->set_root_list(head); });
+        tpool_.wait(task_id);
+    }
+
+    // Only the owner may change its heap, tasks of other threads are not ordered against its own.
+    bool set_heir(pthread_t tid, pthread_t heir) {
+        if (!pthread_equal(tid, pthread_self()))
         {
-            LOG_CRITICAL("%s", "Heap overflow");
-            // std::exit(EXIT_FAILURE);
-            errno = ENOMEM;
+            errno = EINVAL;
+            return false;
         }
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return false; }
+
+        auto task_id = tpool_.add_task([thread_gc, heir]() { thread_gc->set_heir(heir); });
+        tpool_.wait(task_id);
+        return true;
     }
-public:
-    gc_manager() {
-        gc_cnt = 0;
+
+    bool set_budget(pthread_t tid, uint64_t soft, uint64_t hard) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return false; }
+
+        auto task_id = tpool_.add_task([thread_gc, soft, hard]() { thread_gc->set_budget(soft, hard); });
+        tpool_.wait(task_id);
+        return true;
     }
 
-    void add_to_reg(pthread_t tid, gc* new_gc) {
+    unsigned long long int get_gc_live_bytes(pthread_t tid) {
         std::lock_guard reg_lock(reg_mtx_);
-        reg_.insert({tid, new_gc});
-        ++gc_cnt;
-        
-        if (tpool_.get_threads_n() < gc_cnt)
+        auto itr = reg_.find(tid);
+        return itr->second->get_live_bytes();
+    }
+
+    unsigned long long int get_gc_huge_page_bytes(pthread_t tid) {
+        std::lock_guard reg_lock(reg_mtx_);
+        auto itr = reg_.find(tid);
+        return itr->second->get_huge_page_bytes();
+    }
+
+    // Censuses are copied under the registry lock, so heaps cannot be retired meanwhile.
+    bool census(pthread_t tid, gc_census* total, gc_census_visitor visit, void* arg) {
+        std::vector<std::pair<pthread_t, gc_census>> heaps;
+        if (!collect_census(tid, heaps)) { return false; }
+
+        gc_census sum = {};
+        for (const auto& [heap_tid, heap_census] : heaps)
         {
-            tpool_.add_thread();
-            LOG_DEBUG("%s", "Added 1 thread to thread pool");
+            if (visit != NULL) { visit(heap_tid, &heap_census, arg); }
+            census_merge(sum, heap_census);
         }
+        census_malloc_stats(sum);
+        if (total != NULL) { *total = sum; }
+        return true;
     }
 
-    bool contains(pthread_t tid) {
-        std::lock_guard reg_lock(reg_mtx_);
-        return reg_.contains(tid);
+    bool census_dump(const char* path, int format) {
+        std::vector<std::pair<pthread_t, gc_census>> heaps;
+        collect_census(GC_ALL_HEAPS, heaps);
+
+        gc_census sum = {};
+        for (const auto& [heap_tid, heap_census] : heaps)
+        {
+            census_merge(sum, heap_census);
+        }
+        census_malloc_stats(sum);
+        return census_write(path, format, heaps, sum);
     }
 
-    void erase_from_reg(pthread_t tid) {
+    bool collect_census(pthread_t tid, std::vector<std::pair<pthread_t, gc_census>>& heaps) {
         std::lock_guard reg_lock(reg_mtx_);
+        if (tid == GC_ALL_HEAPS)
+        {
+            for (const auto& [heap_tid, heap] : reg_)
+            {
+                heaps.emplace_back(heap_tid, gc_census{});
+                heap->get_census(heaps.back().second);
+            }
+            heaps.emplace_back(GC_ORPHAN_HEAP, gc_census{});
+            orphan_->get_census(heaps.back().second);
+            return true;
+        }
+
+        gc* heap = tid == GC_ORPHAN_HEAP ? orphan_ : NULL;
         auto itr = reg_.find(tid);
-        if (itr == reg_.end()) return;
-        delete itr->second;
-        reg_.erase(itr);
+        if (itr != reg_.end()) { heap = itr->second; }
+        if (heap == NULL)
+        {
+            errno = EINVAL;
+            return false;
+        }
+        heaps.emplace_back(tid, gc_census{});
+        heap->get_census(heaps.back().second);
+        return true;
+    }
+
+    unsigned long long int get_orphan_allocs_cnt() {
+        std::lock_guard orphan_lock(orphan_mtx_);
+        return orphan_->get_allocs_cnt();
     }
 
     unsigned long long int get_gc_allocs_cnt(pthread_t tid) {
@@ -332,25 +2413,110 @@ public:
         return itr->second->get_roots_cnt();
     }
 
-    void do_malloc(pthread_t tid, void*& dest, size_t size) {
+    void do_malloc(pthread_t tid, void*& dest, size_t size, uint32_t flags = 0) {
         gc* thread_gc = get_gc(tid);
         if (thread_gc == NULL) { return; }
         
+        // The stack is captured here, on the calling thread, not on the pool worker.
+        alloc_site* site = thread_gc->sampler.sample(size);
         
         EERROR error;
-        auto task_id = tpool_.add_task([thread_gc](size_t size, void*& res, EERROR& err) -> void {
-                                            thread_gc->gc_malloc(size, res, err); 
+        auto task_id = tpool_.add_task([thread_gc, site, flags](size_t size, void*& res, EERROR& err) -> void {
+                                            thread_gc->gc_malloc(size, res, err, site, flags); 
+                                            if (err == EERROR::PROCESS_SOFT && res != NULL) { thread_gc->hold(res); }
                                         },
                                         size,
                                         std::ref(dest),
                                         std::ref(error));
         tpool_.wait(task_id);
         
-        if (error == EERROR::NOMEM)
+        // Memory held by other heaps can only be reclaimed by a global collection.
+        if (error == EERROR::NOMEM || error == EERROR::PROCESS_BUDGET)
+        {
+            nomem_handler(tid, thread_gc, dest, size, site, flags);
+        } else if (error == EERROR::PROCESS_SOFT)
+        {
+            soft_budget_run(tid, thread_gc, dest);
+        } else if (error == EERROR::BUDGET)
         {
-            nomem_handler(tid, thread_gc, dest, size);
+            if (site != NULL) { profiler_release(site, size); }
+            report_alloc_error(error);
         }
-        
+    }
+
+    void do_realloc(pthread_t tid, void*& dest, size_t size) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return; }
+
+        alloc_site* site = dest == NULL ? thread_gc->sampler.sample(size) : NULL;
+
+        EERROR error;
+        auto realloc_task = [this, thread_gc, site, size, &dest, &error]() {
+            auto task_id = tpool_.add_task([thread_gc, site](size_t size, void*& res, EERROR& err) -> void {
+                                                thread_gc->gc_realloc(res, size, res, err, site);
+                                                if (err == EERROR::PROCESS_SOFT && res != NULL) { thread_gc->hold(res); }
+                                            },
+                                            size,
+                                            std::ref(dest),
+                                            std::ref(error));
+            tpool_.wait(task_id);
+        };
+        realloc_task();
+
+        if (error == EERROR::PROCESS_SOFT)
+        {
+            soft_budget_run(tid, thread_gc, dest);
+        } else if (error == EERROR::NOMEM || error == EERROR::PROCESS_BUDGET)
+        {
+            // The old block is referenced only by the caller's variable, like in the first attempt
+            void* old = dest;
+            if (old != NULL)
+            {
+                auto task_id = tpool_.add_task([thread_gc, old]() { thread_gc->hold(old); });
+                tpool_.wait(task_id);
+            }
+            global_run(tid);
+            realloc_task();
+
+            auto task_id = tpool_.add_task([thread_gc, old, &dest, &error]() {
+                if (old != NULL) { thread_gc->unhold(old); }
+                // The global collection this allocation asks for has just run
+                if (error == EERROR::PROCESS_SOFT && dest != NULL) { thread_gc->unhold(dest); }
+            });
+            tpool_.wait(task_id);
+        }
+        if (error != EERROR::NONE && error != EERROR::PROCESS_SOFT && site != NULL)
+        {
+            profiler_release(site, size);
+        }
+        report_alloc_error(error);
+    }
+
+    void do_malloc_movable(pthread_t tid, gc_handle& dest, size_t size) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return; }
+
+        EERROR error;
+        auto malloc_movable = [this, thread_gc, size, &dest, &error]() {
+            auto task_id = tpool_.add_task([thread_gc](size_t size, gc_handle& res, EERROR& err) -> void {
+                                                thread_gc->gc_malloc_movable(size, res, err);
+                                            },
+                                            size,
+                                            std::ref(dest),
+                                            std::ref(error));
+            tpool_.wait(task_id);
+        };
+        malloc_movable();
+
+        if (error == EERROR::NOMEM || error == EERROR::PROCESS_BUDGET || error == EERROR::PROCESS_SOFT)
+        {
+            global_run(tid);
+            if (error != EERROR::PROCESS_SOFT)
+            {
+                malloc_movable();
+            }
+        }
+        report_alloc_error(error);
     }
 
     void do_free(pthread_t tid, void* addr) {
@@ -361,6 +2527,48 @@ public:
         tpool_.wait(task_id);
     }
 
+    void do_retain(pthread_t tid, void* addr) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return; }
+
+        auto task_id = tpool_.add_task([thread_gc](void* addr) { thread_gc->retain(addr); }, addr);
+        tpool_.wait(task_id);
+    }
+
+    void do_release(pthread_t tid, void* addr) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return; }
+
+        auto task_id = tpool_.add_task([thread_gc](void* addr) { thread_gc->release(addr); }, addr);
+        tpool_.wait(task_id);
+    }
+
+    unsigned long long int do_rc_flush(pthread_t tid) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return 0; }
+
+        size_t freed = 0;
+        auto task_id = tpool_.add_task([thread_gc](size_t& res) { res = thread_gc->process_zct(); }, std::ref(freed));
+        tpool_.wait(task_id);
+        return freed;
+    }
+
+    void do_pin(pthread_t tid, gc_handle handle) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return; }
+
+        auto task_id = tpool_.add_task([thread_gc](gc_handle handle) { thread_gc->pin(handle); }, handle);
+        tpool_.wait(task_id);
+    }
+
+    void do_unpin(pthread_t tid, gc_handle handle) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return; }
+
+        auto task_id = tpool_.add_task([thread_gc](gc_handle handle) { thread_gc->unpin(handle); }, handle);
+        tpool_.wait(task_id);
+    }
+
     void do_root_marking(pthread_t tid, void* addr) {
         gc* thread_gc = get_gc(tid);
         if (thread_gc == NULL) { return; }
@@ -377,17 +2585,57 @@ public:
         tpool_.wait(task_id);
     }
 
+    gc_weak_ref* do_weak_create(pthread_t tid, void* addr) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return NULL; }
+
+        gc_weak_ref* ref = NULL;
+        auto task_id = tpool_.add_task([thread_gc](void* addr, gc_weak_ref*& res) { res = thread_gc->weak_create(addr); },
+                                        addr,
+                                        std::ref(ref));
+        tpool_.wait(task_id);
+
+        if (ref == NULL)
+        {
+            errno = EINVAL;
+        }
+        return ref;
+    }
+
+    void* do_weak_get(pthread_t tid, gc_weak_ref* ref) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return NULL; }
+
+        void* target = NULL;
+        auto task_id = tpool_.add_task([thread_gc](gc_weak_ref* ref, void*& res) { res = thread_gc->weak_get(ref); },
+                                        ref,
+                                        std::ref(target));
+        tpool_.wait(task_id);
+        return target;
+    }
+
+    void do_weak_destroy(pthread_t tid, gc_weak_ref* ref) {
+        gc* thread_gc = get_gc(tid);
+        if (thread_gc == NULL) { return; }
+
+        auto task_id = tpool_.add_task([thread_gc](gc_weak_ref* ref) { thread_gc->weak_destroy(ref); }, ref);
+        tpool_.wait(task_id);
+    }
+
     void do_collect(pthread_t tid, int flag = THREAD_LOCAL) {
         if (flag == GLOBAL)
         {   
             global_run(tid);
             return;
+        } else if (flag == GLOBAL_SNAPSHOT)
+        {
+            snapshot_run(tid);
         } else if (flag == THREAD_LOCAL)
         {
             gc* thread_gc = get_gc(tid);
             if (thread_gc == NULL) { return; }
 
-            auto task_id = tpool_.add_task([thread_gc]() { thread_gc->collect(); });
+            auto task_id = tpool_.add_task_on(thread_gc->node(), [thread_gc]() { thread_gc->collect(); });
             tpool_.wait(task_id);
         } else {
             errno = EINVAL;
@@ -399,27 +2647,106 @@ static gc_manager manager;
 
 
 void manager_malloc_wrapper(pthread_t tid, void** dest, size_t size) {
+    latency_call call(GC_OP_MALLOC);
     LOG_DEBUG("Malloc destination: %p", dest);
     manager.do_malloc(tid, *dest, size);
+    RECORD(MALLOC, tid, *dest, dest, size);
+}
+
+void manager_malloc_atomic_wrapper(pthread_t tid, void** dest, size_t size) {
+    latency_call call(GC_OP_MALLOC_ATOMIC);
+    manager.do_malloc(tid, *dest, size, ALLOC_NO_SCAN);
+    RECORD(MALLOC, tid, *dest, dest, size);
+}
+
+void manager_calloc_wrapper(pthread_t tid, void** dest, size_t nmemb, size_t size) {
+    latency_call call(GC_OP_CALLOC);
+    if (size != 0 && nmemb > SIZE_MAX / size)
+    {
+        errno = ENOMEM;
+        return;
+    }
+    manager.do_malloc(tid, *dest, nmemb * size, ALLOC_ZEROED);
+    RECORD(CALLOC, tid, *dest, dest, nmemb * size);
+}
+
+void manager_malloc_rc_wrapper(pthread_t tid, void** dest, size_t size) {
+    latency_call call(GC_OP_MALLOC_RC);
+    manager.do_malloc(tid, *dest, size, ALLOC_COUNTED);
+    RECORD(MALLOC, tid, *dest, dest, size);
+}
+
+void manager_retain_wrapper(pthread_t tid, void* addr) {
+    latency_call call(GC_OP_RETAIN);
+    manager.do_retain(tid, addr);
+}
+
+void manager_release_wrapper(pthread_t tid, void* addr) {
+    latency_call call(GC_OP_RELEASE);
+    manager.do_release(tid, addr);
+}
+
+void manager_realloc_wrapper(pthread_t tid, void** ptr, size_t size) {
+    latency_call call(GC_OP_REALLOC);
+    manager.do_realloc(tid, *ptr, size);
+    RECORD(REALLOC, tid, *ptr, ptr, size);
+}
+
+void manager_malloc_movable_wrapper(pthread_t tid, gc_handle* dest, size_t size) {
+    latency_call call(GC_OP_MALLOC_MOVABLE);
+    manager.do_malloc_movable(tid, *dest, size);
+}
+
+void manager_pin_wrapper(pthread_t tid, gc_handle handle) {
+    latency_call call(GC_OP_PIN);
+    manager.do_pin(tid, handle);
+}
+
+void manager_unpin_wrapper(pthread_t tid, gc_handle handle) {
+    latency_call call(GC_OP_UNPIN);
+    manager.do_unpin(tid, handle);
 }
 
 void manager_free_wrapper(pthread_t tid, void* addr) {
+    latency_call call(GC_OP_FREE);
+    RECORD(FREE, tid, addr, NULL, 0);
     manager.do_free(tid, addr);
 }
 
 void manager_mark_root__wrapper(pthread_t tid, void* addr) {
+    latency_call call(GC_OP_MARK_ROOT);
     manager.do_root_marking(tid, addr);
+    RECORD(MARK_ROOT, tid, addr, NULL, 0);
 }
 
 void manager_unmark_root_wrapper(pthread_t tid, void* addr) {
+    latency_call call(GC_OP_UNMARK_ROOT);
     manager.do_root_unmarking(tid, addr);
+    RECORD(UNMARK_ROOT, tid, addr, NULL, 0);
 }
 
 void manager_collect_wrapper(pthread_t tid, int flag) {
+    latency_call call(GC_OP_COLLECT);
+    RECORD(COLLECT, tid, NULL, NULL, flag);
     manager.do_collect(tid, flag);
 }
 
-void stop_world_sig_init() {
+gc_weak_ref* manager_weak_create_wrapper(pthread_t tid, void* addr) {
+    latency_call call(GC_OP_WEAK_CREATE);
+    return manager.do_weak_create(tid, addr);
+}
+
+void* manager_weak_get_wrapper(pthread_t tid, gc_weak_ref* ref) {
+    latency_call call(GC_OP_WEAK_GET);
+    return manager.do_weak_get(tid, ref);
+}
+
+void manager_weak_destroy_wrapper(pthread_t tid, gc_weak_ref* ref) {
+    latency_call call(GC_OP_WEAK_DESTROY);
+    manager.do_weak_destroy(tid, ref);
+}
+
+bool stop_world_sig_init() {
     struct sigaction sa;
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = handle_sigusr1;
@@ -429,11 +2756,17 @@ void stop_world_sig_init() {
         char buf[256];
         if (strerror_r(errno, buf, sizeof(buf)) != 0) {
             LOG_CRITICAL("%s", "Sigaction: Failed to bind SIGUSR1");
-            return;
+            return false;
         }
         LOG_CRITICAL("Sigaction: Failed to bind SIGUSR1: %s", buf);
         // exit(EXIT_FAILURE);
+        return false;
     }
+    return true;
+}
+
+const char* gc_get_config() {
+    return GC_CONFIG::name;
 }
 
 gc_handler gc_get_handler() {
@@ -444,11 +2777,27 @@ gc_handler gc_get_handler() {
     handler.mark_root = &manager_mark_root__wrapper;
     handler.unmark_root = &manager_unmark_root_wrapper;
     handler.collect = &manager_collect_wrapper;
+    handler.gc_weak_create = &manager_weak_create_wrapper;
+    handler.gc_weak_get = &manager_weak_get_wrapper;
+    handler.gc_weak_destroy = &manager_weak_destroy_wrapper;
+    handler.gc_malloc_movable = &manager_malloc_movable_wrapper;
+    handler.gc_pin = &manager_pin_wrapper;
+    handler.gc_unpin = &manager_unpin_wrapper;
+    handler.gc_realloc = &manager_realloc_wrapper;
+    handler.gc_calloc = &manager_calloc_wrapper;
+    handler.gc_malloc_atomic = &manager_malloc_atomic_wrapper;
+    handler.gc_malloc_rc = &manager_malloc_rc_wrapper;
+    handler.gc_retain = &manager_retain_wrapper;
+    handler.gc_release = &manager_release_wrapper;
 
     return handler;
 }
 
 gc_handler gc_create(pthread_t tid) {
+    return gc_create_ex(tid, 0);
+}
+
+gc_handler gc_create_ex(pthread_t tid, int flags) {
     if (manager.contains(tid))
     {
         LOG_WARNING("Thread with id: %lld already has GC", (long long int)tid);
@@ -456,23 +2805,147 @@ gc_handler gc_create(pthread_t tid) {
         return handler;
     }
 
-    stop_world_sig_init();
-    if (errno == EFAULT || errno == EINVAL)
+    if (!stop_world_sig_init())
     {
         LOG_CRITICAL("%s", "Failed to create GC due to error in sigaction");
         return gc_get_handler();
     }
 
-    manager.add_to_reg(tid, new gc);
+    gc* new_gc = manager.new_heap();
+    new_gc->set_background((flags & GC_FLAG_BACKGROUND) != 0);
+    new_gc->set_huge_pages((flags & GC_FLAG_HUGE_PAGES) != 0);
+    new_gc->set_dirty_pages((flags & GC_FLAG_DIRTY_PAGES) != 0);
+    new_gc->set_scan_data((flags & GC_FLAG_SCAN_DATA) != 0);
+    if (pthread_equal(tid, pthread_self()))
+    {
+        stopped_sp_slot = &new_gc->stopped_sp;
+        manager.watch_thread_exit(true);
+    }
+    manager.add_to_reg(tid, new_gc);
+    RECORD(CREATE, tid, NULL, NULL, flags);
 
     return gc_get_handler();
 }
 
 void gc_stop(pthread_t tid) {
+    if (pthread_equal(tid, pthread_self()))
+    {
+        stopped_sp_slot = NULL;
+        manager.watch_thread_exit(false);
+    }
+    RECORD(STOP, tid, NULL, NULL, 0);
     manager.erase_from_reg(tid);
 }
 
+long long int gc_transfer(pthread_t from_tid, pthread_t to_tid, void* root) {
+    return manager.do_transfer(from_tid, to_tid, root);
+}
+
+int gc_region_begin(pthread_t tid) {
+    return manager.region_begin(tid) ? 0 : -1;
+}
+
+int gc_region_end(pthread_t tid) {
+    return manager.region_end(tid) ? 0 : -1;
+}
+
+void* gc_region_promote(pthread_t tid, void* ptr) {
+    return manager.region_promote(tid, ptr);
+}
+
+int gc_pressure_start(const char* psi_path, const char* cgroup_dir) {
+    return manager.pressure_start(psi_path, cgroup_dir) ? 0 : -1;
+}
+
+void gc_pressure_stop() {
+    manager.pressure_stop();
+}
+
+unsigned long long int gc_pressure_events() {
+    return manager.get_pressure_events();
+}
+
+int gc_heap_census(pthread_t tid, gc_census* total, gc_census_visitor visit, void* arg) {
+    return manager.census(tid, total, visit, arg) ? 0 : -1;
+}
+
+int gc_census_dump(const char* path, int format) {
+    if (path == NULL || (format != GC_CENSUS_TEXT && format != GC_CENSUS_JSON))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return manager.census_dump(path, format) ? 0 : -1;
+}
+
+unsigned long long int gc_rc_flush(pthread_t tid) {
+    return manager.do_rc_flush(tid);
+}
+
+int gc_collect_budget(pthread_t tid, int flag, uint64_t max_ns) {
+    return manager.do_collect_budget(tid, flag, max_ns);
+}
+
+void gc_set_root_list(pthread_t tid, gc_root_node* head) {
+    manager.set_root_list(tid, head);
+}
+
+int gc_adopt_on_stop(pthread_t tid, pthread_t heir_tid) {
+    return manager.set_heir(tid, heir_tid) ? 0 : -1;
+}
+
+int gc_set_budget(pthread_t tid, size_t soft_bytes, size_t hard_bytes) {
+    if (hard_bytes != 0 && soft_bytes > hard_bytes)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return manager.set_budget(tid, soft_bytes, hard_bytes) ? 0 : -1;
+}
+
+int gc_set_process_budget(size_t soft_bytes, size_t hard_bytes) {
+    if (hard_bytes != 0 && soft_bytes > hard_bytes)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    process_soft_budget.store(soft_bytes);
+    process_hard_budget.store(hard_bytes);
+    process_soft_reached.store(false);
+    return 0;
+}
+
+unsigned long long int gc_get_live_bytes(pthread_t tid) {
+    if (!manager.contains(tid))
+    {
+        LOG_CRITICAL("Thread with id: %lld does not have GC", (long long int)tid);
+        errno = EINVAL;
+        return 0;
+    }
+    return manager.get_gc_live_bytes(tid);
+}
+
+unsigned long long int gc_get_huge_page_bytes(pthread_t tid) {
+    if (!manager.contains(tid))
+    {
+        LOG_CRITICAL("Thread with id: %lld does not have GC", (long long int)tid);
+        errno = EINVAL;
+        return 0;
+    }
+    return manager.get_gc_huge_page_bytes(tid);
+}
+
+unsigned long long int gc_get_process_live_bytes() {
+    return process_live_bytes.load();
+}
+
 unsigned long long int gc_get_allocs_cnt(pthread_t tid) {
+    if (tid == GC_ORPHAN_HEAP)
+    {
+        return manager.get_orphan_allocs_cnt();
+    }
     if (!manager.contains(tid))
     {
         LOG_CRITICAL("Thread with id: %lld does not have GC", (long long int)tid);
@@ -0,0 +1,154 @@
+#include "gc/gc.h"
+#include "gc/log.h"
+#include "gc/latency.h"
+
+#include <mutex>
+#include <vector>
+
+// Values below GC_LATENCY_SUB_BUCKETS have a bucket each. Above, every power of two is split into
+// GC_LATENCY_SUB_BUCKETS buckets, so a value is known to within 1/GC_LATENCY_SUB_BUCKETS of itself.
+#define LATENCY_SUB_BITS 3
+
+static_assert(GC_LATENCY_SUB_BUCKETS == 1 << LATENCY_SUB_BITS, "sub-buckets are the top bits of a value");
+
+std::atomic<bool> latency_on = false;
+thread_local latency_scope* latency_current = NULL;
+
+// Written by its owner thread only, so updates are plain loads and stores of relaxed atomics. Blocks of
+// exited threads keep their counts and are handed to new threads.
+struct latency_block
+{
+    std::atomic<uint64_t> count[GC_OP_CNT][GC_LATENCY_PARTS];
+    std::atomic<uint64_t> sum_ns[GC_OP_CNT][GC_LATENCY_PARTS];
+    std::atomic<uint64_t> max_ns[GC_OP_CNT][GC_LATENCY_PARTS];
+    std::atomic<uint64_t> buckets[GC_OP_CNT][GC_LATENCY_PARTS][GC_LATENCY_BUCKETS];
+    std::atomic<bool> owned;
+};
+
+static std::mutex blocks_mtx;
+static std::vector<latency_block*> blocks;
+
+static latency_block* acquire_block() {
+    std::lock_guard blocks_lock(blocks_mtx);
+    for (auto block : blocks)
+    {
+        if (!block->owned.load())
+        {
+            block->owned.store(true);
+            return block;
+        }
+    }
+    latency_block* block = new latency_block();
+    block->owned.store(true);
+    blocks.push_back(block);
+    return block;
+}
+
+struct latency_owner
+{
+    latency_block* block = NULL;
+
+    ~latency_owner() {
+        if (block != NULL) { block->owned.store(false); }
+    }
+};
+
+static thread_local latency_owner owner;
+
+static size_t latency_bucket(uint64_t value) {
+    if (value < GC_LATENCY_SUB_BUCKETS) { return value; }
+
+    int exp = 63 - __builtin_clzll(value);
+    size_t bucket = (exp - LATENCY_SUB_BITS + 1) * GC_LATENCY_SUB_BUCKETS +
+                    ((value >> (exp - LATENCY_SUB_BITS)) & (GC_LATENCY_SUB_BUCKETS - 1));
+    return bucket < GC_LATENCY_BUCKETS ? bucket : GC_LATENCY_BUCKETS - 1;
+}
+
+static void bump(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+void latency_record(const latency_scope& scope, uint64_t end_ns) {
+    if (owner.block == NULL) { owner.block = acquire_block(); }
+    latency_block* block = owner.block;
+
+    uint64_t parts[GC_LATENCY_PARTS];
+    for (int part = 0; part < GC_LATENCY_PARTS; part++)
+    {
+        parts[part] = scope.parts[part];
+    }
+    parts[GC_LATENCY_TOTAL] = end_ns - scope.start_ns;
+
+    for (int part = 0; part < GC_LATENCY_PARTS; part++)
+    {
+        uint64_t value = parts[part];
+        bump(block->count[scope.op][part], 1);
+        bump(block->sum_ns[scope.op][part], value);
+        bump(block->buckets[scope.op][part][latency_bucket(value)], 1);
+        if (value > block->max_ns[scope.op][part].load(std::memory_order_relaxed))
+        {
+            block->max_ns[scope.op][part].store(value, std::memory_order_relaxed);
+        }
+    }
+}
+
+int gc_latency_start() {
+    latency_on.store(true);
+    return 0;
+}
+
+void gc_latency_stop() {
+    latency_on.store(false);
+}
+
+int gc_latency_snapshot(int op, int part, gc_latency_hist* hist) {
+    if (op < 0 || op >= GC_OP_CNT || part < 0 || part >= GC_LATENCY_PARTS || hist == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(hist, 0, sizeof(*hist));
+    std::lock_guard blocks_lock(blocks_mtx);
+    for (auto block : blocks)
+    {
+        hist->count += block->count[op][part].load(std::memory_order_relaxed);
+        hist->sum_ns += block->sum_ns[op][part].load(std::memory_order_relaxed);
+        uint64_t max_ns = block->max_ns[op][part].load(std::memory_order_relaxed);
+        if (max_ns > hist->max_ns) { hist->max_ns = max_ns; }
+        for (int i = 0; i < GC_LATENCY_BUCKETS; i++)
+        {
+            hist->buckets[i] += block->buckets[op][part][i].load(std::memory_order_relaxed);
+        }
+    }
+    return 0;
+}
+
+unsigned long long int gc_latency_bucket_limit(int bucket) {
+    if (bucket < GC_LATENCY_SUB_BUCKETS) { return bucket < 0 ? 0 : bucket; }
+    if (bucket >= GC_LATENCY_BUCKETS - 1) { return UINT64_MAX; }
+
+    int exp = bucket / GC_LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+    uint64_t sub = bucket % GC_LATENCY_SUB_BUCKETS;
+    uint64_t width = 1ull << (exp - LATENCY_SUB_BITS);
+    return ((GC_LATENCY_SUB_BUCKETS + sub) << (exp - LATENCY_SUB_BITS)) + width - 1;
+}
+
+unsigned long long int gc_latency_percentile(const gc_latency_hist* hist, double quantile) {
+    if (hist == NULL || hist->count == 0) { return 0; }
+
+    uint64_t rank = static_cast<uint64_t>(quantile * static_cast<double>(hist->count));
+    if (rank >= hist->count) { rank = hist->count - 1; }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < GC_LATENCY_BUCKETS; i++)
+    {
+        seen += hist->buckets[i];
+        if (seen > rank)
+        {
+            unsigned long long int limit = gc_latency_bucket_limit(i);
+            return limit < hist->max_ns ? limit : hist->max_ns;
+        }
+    }
+    return hist->max_ns;
+}
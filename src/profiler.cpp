@@ -0,0 +1,222 @@
+#include "gc/gc.h"
+#include "gc/log.h"
+#include "gc/profiler.h"
+#include "gc/latency.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <math.h>
+#include <execinfo.h>
+
+// profiler_sampler::sample and take_sample itself.
+#define PROFILER_SKIP_FRAMES 2
+// Collections rewrite the report file at most this often.
+#define PROFILER_REPORT_PERIOD_NS 1000000000ull
+
+std::atomic<size_t> profiler_sample_bytes = 0;
+
+class alloc_profiler {
+private:
+    std::mutex sites_mtx_;
+    std::unordered_map<uint64_t, alloc_site*> sites_;
+    std::string report_path_;
+    size_t sample_period_ = PROFILER_DEFAULT_SAMPLE_BYTES;
+    std::atomic<uint64_t> reported_ns_ = 0;     // 0 until the first report after configure
+
+    static uint64_t hash_frames(void** frames, int depth) {
+        uint64_t hash = 14695981039346656037ull;
+        for (int i = 0; i < depth; i++)
+        {
+            hash ^= reinterpret_cast<uint64_t>(frames[i]);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool write_profile(const char* path) {
+        FILE* out = fopen(path, "w");
+        if (out == NULL)
+        {
+            LOG_WARNING("Failed to open profile file %s", path);
+            return false;
+        }
+
+        uint64_t live_cnt = 0, live_bytes = 0, total_cnt = 0, total_bytes = 0;
+        for (const auto& [hash, head] : sites_)
+        {
+            for (alloc_site* site = head; site != NULL; site = site->next)
+            {
+                live_cnt += site->live_cnt.load(std::memory_order_relaxed);
+                live_bytes += site->live_bytes.load(std::memory_order_relaxed);
+                total_cnt += site->total_cnt.load(std::memory_order_relaxed);
+                total_bytes += site->total_bytes.load(std::memory_order_relaxed);
+            }
+        }
+
+        // Legacy gperftools heap profile, understood by pprof.
+        fprintf(out, "heap profile: %llu: %llu [%llu: %llu] @ heap_v2/%llu\n",
+                (unsigned long long)live_cnt, (unsigned long long)live_bytes,
+                (unsigned long long)total_cnt, (unsigned long long)total_bytes,
+                (unsigned long long)sample_period_);
+
+        for (const auto& [hash, head] : sites_)
+        {
+            for (alloc_site* site = head; site != NULL; site = site->next)
+            {
+                fprintf(out, "%llu: %llu [%llu: %llu] @",
+                        (unsigned long long)site->live_cnt.load(std::memory_order_relaxed),
+                        (unsigned long long)site->live_bytes.load(std::memory_order_relaxed),
+                        (unsigned long long)site->total_cnt.load(std::memory_order_relaxed),
+                        (unsigned long long)site->total_bytes.load(std::memory_order_relaxed));
+                for (int i = 0; i < site->depth; i++)
+                {
+                    fprintf(out, " %p", site->frames[i]);
+                }
+                fprintf(out, "\n");
+            }
+        }
+
+        fprintf(out, "\nMAPPED_LIBRARIES:\n");
+        FILE* maps = fopen("/proc/self/maps", "r");
+        if (maps != NULL)
+        {
+            char buf[4096];
+            size_t len;
+            while ((len = fread(buf, 1, sizeof(buf), maps)) > 0)
+            {
+                fwrite(buf, 1, len, out);
+            }
+            fclose(maps);
+        }
+
+        fclose(out);
+        return true;
+    }
+public:
+    alloc_site* find_site(void** frames, int depth) {
+        uint64_t hash = hash_frames(frames, depth);
+
+        std::lock_guard sites_lock(sites_mtx_);
+        alloc_site*& head = sites_[hash];
+        for (alloc_site* site = head; site != NULL; site = site->next)
+        {
+            if (site->depth == depth && memcmp(site->frames, frames, depth * sizeof(void*)) == 0)
+            {
+                return site;
+            }
+        }
+
+        alloc_site* site = new alloc_site;
+        site->hash = hash;
+        site->depth = depth;
+        memcpy(site->frames, frames, depth * sizeof(void*));
+        site->total_cnt = 0;
+        site->total_bytes = 0;
+        site->live_cnt = 0;
+        site->live_bytes = 0;
+        site->next = head;
+        head = site;
+        return site;
+    }
+
+    void configure(size_t sample_period, const char* report_path) {
+        std::lock_guard sites_lock(sites_mtx_);
+        sample_period_ = sample_period;
+        report_path_ = report_path != NULL ? report_path : "";
+        reported_ns_.store(0);
+    }
+
+    // Collections of many heaps may end at once, only the one that claims the period writes.
+    void report() {
+        uint64_t now = latency_now();
+        uint64_t reported = reported_ns_.load();
+        if (reported != 0 && now - reported < PROFILER_REPORT_PERIOD_NS) { return; }
+        if (!reported_ns_.compare_exchange_strong(reported, now)) { return; }
+
+        std::lock_guard sites_lock(sites_mtx_);
+        if (report_path_.empty()) { return; }
+        write_profile(report_path_.c_str());
+    }
+
+    bool dump(const char* path) {
+        std::lock_guard sites_lock(sites_mtx_);
+        return write_profile(path);
+    }
+
+    ~alloc_profiler() {
+        for (const auto& [hash, head] : sites_)
+        {
+            for (alloc_site* site = head; site != NULL;)
+            {
+                alloc_site* next = site->next;
+                delete site;
+                site = next;
+            }
+        }
+    }
+};
+
+static alloc_profiler profiler;
+
+alloc_site* profiler_sampler::take_sample(size_t size, size_t interval) {
+    // Exponentially distributed distance between samples, so that allocation patterns cannot alias with it.
+    if (rnd_state == 0)
+    {
+        rnd_state = reinterpret_cast<uint64_t>(this) | 1;
+    }
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    double uniform = (static_cast<double>(rnd_state >> 11) + 1.0) / 9007199254740993.0;
+    bytes_until_sample = static_cast<int64_t>(-log(uniform) * static_cast<double>(interval)) + 1;
+
+    void* frames[PROFILER_MAX_DEPTH + PROFILER_SKIP_FRAMES];
+    int depth = backtrace(frames, PROFILER_MAX_DEPTH + PROFILER_SKIP_FRAMES);
+    int skip = depth > PROFILER_SKIP_FRAMES ? PROFILER_SKIP_FRAMES : 0;
+
+    alloc_site* site = profiler.find_site(frames + skip, depth - skip);
+    site->total_cnt.fetch_add(1, std::memory_order_relaxed);
+    site->total_bytes.fetch_add(size, std::memory_order_relaxed);
+    site->live_cnt.fetch_add(1, std::memory_order_relaxed);
+    site->live_bytes.fetch_add(size, std::memory_order_relaxed);
+    return site;
+}
+
+void profiler_release(alloc_site* site, size_t size) {
+    site->live_cnt.fetch_sub(1, std::memory_order_relaxed);
+    site->live_bytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+void profiler_resize(alloc_site* site, size_t old_size, size_t new_size) {
+    site->live_bytes.fetch_sub(old_size, std::memory_order_relaxed);
+    site->live_bytes.fetch_add(new_size, std::memory_order_relaxed);
+}
+
+void profiler_report() {
+    if (profiler_sample_bytes.load(std::memory_order_relaxed) == 0) { return; }
+    profiler.report();
+}
+
+int gc_profiler_start(size_t sample_bytes, const char* report_path) {
+    if (sample_bytes == 0)
+    {
+        sample_bytes = PROFILER_DEFAULT_SAMPLE_BYTES;
+    }
+    profiler.configure(sample_bytes, report_path);
+    profiler_sample_bytes.store(sample_bytes);
+    return 0;
+}
+
+void gc_profiler_stop() {
+    profiler_sample_bytes.store(0);
+}
+
+int gc_profiler_dump(const char* path) {
+    if (path == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return profiler.dump(path) ? 0 : -1;
+}
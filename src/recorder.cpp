@@ -0,0 +1,109 @@
+#include "gc/gc.h"
+#include "gc/log.h"
+#include "gc/recorder.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <time.h>
+
+#define RECORD_BUFFER_ENTRIES 4096
+
+std::atomic<bool> record_on = false;
+
+// Events of all threads go through one buffer, so the file keeps their global order for the replay.
+class event_recorder {
+private:
+    std::mutex mtx_;
+    FILE* out_ = NULL;
+    record_entry buffer_[RECORD_BUFFER_ENTRIES];
+    size_t used_ = 0;
+    std::unordered_map<pthread_t, uint32_t> thread_ids_;
+
+    void flush() {
+        if (used_ == 0) { return; }
+        if (fwrite(buffer_, sizeof(record_entry), used_, out_) != used_)
+        {
+            LOG_WARNING("%s", "Failed to write allocation record");
+        }
+        used_ = 0;
+    }
+public:
+    int start(const char* path) {
+        std::lock_guard lock(mtx_);
+        if (out_ != NULL)
+        {
+            LOG_WARNING("%s", "Recorder is already running");
+            errno = EBUSY;
+            return -1;
+        }
+
+        out_ = fopen(path, "wb");
+        if (out_ == NULL)
+        {
+            LOG_CRITICAL("Failed to open record file %s", path);
+            return -1;
+        }
+        fwrite(RECORD_MAGIC, 1, RECORD_MAGIC_LEN, out_);
+        thread_ids_.clear();
+        used_ = 0;
+        record_on.store(true);
+        return 0;
+    }
+
+    void write(RECORD_KIND kind, pthread_t tid, const void* obj, const void* slot, uint64_t size) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        std::lock_guard lock(mtx_);
+        if (out_ == NULL) { return; }
+
+        auto itr = thread_ids_.try_emplace(tid, static_cast<uint32_t>(thread_ids_.size())).first;
+
+        record_entry& entry = buffer_[used_++];
+        entry.ts_ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+        entry.obj = reinterpret_cast<uint64_t>(obj);
+        entry.slot = reinterpret_cast<uint64_t>(slot);
+        entry.size = size;
+        entry.tid = itr->second;
+        entry.kind = kind;
+        entry.pad[0] = entry.pad[1] = entry.pad[2] = 0;
+
+        if (used_ == RECORD_BUFFER_ENTRIES)
+        {
+            flush();
+        }
+    }
+
+    void stop() {
+        std::lock_guard lock(mtx_);
+        if (out_ == NULL) { return; }
+
+        record_on.store(false);
+        flush();
+        fclose(out_);
+        out_ = NULL;
+    }
+
+    ~event_recorder() {
+        stop();
+    }
+};
+
+static event_recorder recorder;
+
+void record_event(RECORD_KIND kind, pthread_t tid, const void* obj, const void* slot, uint64_t size) {
+    recorder.write(kind, tid, obj, slot, size);
+}
+
+int gc_record_start(const char* path) {
+    if (path == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return recorder.start(path);
+}
+
+void gc_record_stop() {
+    recorder.stop();
+}
@@ -0,0 +1,226 @@
+#include "gc/gc.h"
+#include "gc/log.h"
+#include "gc/trace.h"
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define TRACE_RING_SIZE 4096
+#define TRACE_DRAIN_PERIOD_MS 10
+
+std::atomic<int> trace_lvl = static_cast<int>(TRACE_LEVEL::OFF);
+
+static const char* trace_event_name[] = {
+    "collect", "mark", "sweep", "global_run", "background_collect", "malloc", "free", "sweep_object", "snapshot_fork"
+};
+
+// Single producer (owning thread) / single consumer (drain thread) ring of binary events.
+struct trace_ring
+{
+    trace_record records[TRACE_RING_SIZE];
+    std::atomic<uint64_t> head = 0;
+    std::atomic<uint64_t> tail = 0;
+    std::atomic<uint64_t> dropped = 0;
+    std::atomic<bool> retired = false;
+};
+
+class trace_collector {
+private:
+    std::mutex rings_mtx_;
+    std::vector<trace_ring*> rings_;
+
+    std::mutex run_mtx_;
+    std::condition_variable run_cv_;
+    std::thread drain_thread_;
+    bool running_ = false;
+    FILE* out_ = NULL;
+    bool first_record_ = true;
+    uint64_t dropped_ = 0;
+
+    void write_record(const trace_record& rec) {
+        fprintf(out_, "%s\n{\"name\":\"%s\",\"cat\":\"gc\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%u",
+                first_record_ ? "" : ",",
+                trace_event_name[static_cast<size_t>(rec.event)],
+                rec.phase,
+                (unsigned long long)(rec.ts_ns / 1000),
+                (unsigned long long)(rec.ts_ns % 1000),
+                (int)getpid(),
+                rec.tid);
+        if (rec.phase == 'i')
+        {
+            fprintf(out_, ",\"s\":\"t\"");
+        }
+        fprintf(out_, ",\"args\":{\"arg\":\"0x%llx\"}}", (unsigned long long)rec.arg);
+        first_record_ = false;
+    }
+
+    void drain() {
+        std::lock_guard rings_lock(rings_mtx_);
+        for (auto itr = rings_.begin(); itr != rings_.end();)
+        {
+            trace_ring* ring = *itr;
+            bool retired = ring->retired.load(std::memory_order_acquire);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+
+            for (; tail < head; ++tail)
+            {
+                write_record(ring->records[tail % TRACE_RING_SIZE]);
+            }
+            ring->tail.store(tail, std::memory_order_release);
+            dropped_ += ring->dropped.exchange(0, std::memory_order_relaxed);
+
+            if (retired)
+            {
+                delete ring;
+                itr = rings_.erase(itr);
+                continue;
+            }
+            ++itr;
+        }
+        fflush(out_);
+    }
+
+    void run() {
+        std::unique_lock run_lock(run_mtx_);
+        while (running_)
+        {
+            run_cv_.wait_for(run_lock, std::chrono::milliseconds(TRACE_DRAIN_PERIOD_MS));
+            drain();
+        }
+    }
+public:
+    trace_ring* register_ring() {
+        trace_ring* ring = new trace_ring;
+        std::lock_guard rings_lock(rings_mtx_);
+        rings_.push_back(ring);
+        return ring;
+    }
+
+    int start(const char* path, int level) {
+        std::lock_guard run_lock(run_mtx_);
+        if (running_)
+        {
+            LOG_WARNING("%s", "Trace is already running");
+            errno = EBUSY;
+            return -1;
+        }
+
+        out_ = fopen(path, "w");
+        if (out_ == NULL)
+        {
+            LOG_CRITICAL("Failed to open trace file %s", path);
+            return -1;
+        }
+
+        fprintf(out_, "{\"traceEvents\":[");
+        first_record_ = true;
+        dropped_ = 0;
+        running_ = true;
+        trace_lvl.store(level, std::memory_order_relaxed);
+        drain_thread_ = std::thread(&trace_collector::run, this);
+        return 0;
+    }
+
+    bool is_running() {
+        std::lock_guard run_lock(run_mtx_);
+        return running_;
+    }
+
+    void stop() {
+        {
+            std::lock_guard run_lock(run_mtx_);
+            if (!running_) { return; }
+            trace_lvl.store(static_cast<int>(TRACE_LEVEL::OFF), std::memory_order_relaxed);
+            running_ = false;
+        }
+        run_cv_.notify_all();
+        drain_thread_.join();
+
+        drain();
+        fprintf(out_, "\n],\"otherData\":{\"dropped_events\":\"%llu\"}}\n", (unsigned long long)dropped_);
+        fclose(out_);
+        out_ = NULL;
+    }
+
+    ~trace_collector() {
+        stop();
+        for (auto ring : rings_)
+        {
+            delete ring;
+        }
+    }
+};
+
+static trace_collector collector;
+
+struct trace_ring_holder
+{
+    trace_ring* ring = NULL;
+    uint32_t tid = 0;
+
+    ~trace_ring_holder() {
+        if (ring != NULL)
+        {
+            ring->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local trace_ring_holder local_ring;
+
+void trace_emit(TRACE_EVENT event, char phase, uint64_t arg) {
+    if (local_ring.ring == NULL)
+    {
+        local_ring.ring = collector.register_ring();
+        local_ring.tid = static_cast<uint32_t>(syscall(SYS_gettid));
+    }
+    trace_ring* ring = local_ring.ring;
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= TRACE_RING_SIZE)
+    {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    trace_record& rec = ring->records[head % TRACE_RING_SIZE];
+    rec.ts_ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+    rec.arg = arg;
+    rec.tid = local_ring.tid;
+    rec.event = event;
+    rec.phase = phase;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+int gc_trace_start(const char* path, int level) {
+    if (path == NULL || level < GC_TRACE_OFF || level > GC_TRACE_OBJECTS)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return collector.start(path, level);
+}
+
+void gc_trace_set_level(int level) {
+    if (level < GC_TRACE_OFF || level > GC_TRACE_OBJECTS)
+    {
+        errno = EINVAL;
+        return;
+    }
+    if (!collector.is_running()) { return; }
+    trace_lvl.store(level, std::memory_order_relaxed);
+}
+
+void gc_trace_stop() {
+    collector.stop();
+}
@@ -2,6 +2,8 @@
 #include "gc/minunit.h"
 #include <pthread.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <time.h>
 
 // Structure to test complex objects with pointers
 typedef struct test_node {
@@ -71,6 +73,95 @@ char* test_gc_malloc_free() {
     return NULL;
 }
 
+// Test growing a block with realloc instead of malloc + copy
+char* test_gc_realloc() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    int* arr = NULL;
+    GC_MARK_ROOT(arr);
+    GC_REALLOC(arr, 4 * sizeof(int));
+    MU_ASSERT(arr != NULL, "GC_REALLOC of NULL failed to allocate memory");
+
+    // Doubling up to a size served by mmap
+    size_t len = 4;
+    for (size_t i = 0; i < len; i++) { arr[i] = (int)i; }
+    while (len < 256 * 1024)
+    {
+        GC_REALLOC(arr, 2 * len * sizeof(int));
+        MU_ASSERT(arr != NULL, "GC_REALLOC failed to grow memory");
+        for (size_t i = len; i < 2 * len; i++) { arr[i] = (int)i; }
+        len *= 2;
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        MU_ASSERT(arr[i] == (int)i, "GC_REALLOC lost the contents");
+    }
+
+    // The old blocks are not left for the collector
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == 1, "GC_REALLOC left garbage behind");
+    MU_ASSERT(gc_get_live_bytes(pthread_self()) == len * sizeof(int), "Wrong live bytes after GC_REALLOC");
+
+    GC_COLLECT(THREAD_LOCAL);
+    allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == 1 && arr[len - 1] == (int)(len - 1), "Reallocated block was collected");
+
+    // A block of no heap is refused
+    int local = 0;
+    int* foreign = &local;
+    errno = 0;
+    GC_REALLOC(foreign, 64);
+    MU_ASSERT(foreign == NULL && errno == EINVAL, "GC_REALLOC of a foreign block did not fail with EINVAL");
+
+    GC_UNMARK_ROOT(arr);
+    GC_STOP();
+    return NULL;
+}
+
+// Test zeroed allocation, both of fresh and of recycled memory
+char* test_gc_calloc() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    // Dirty some blocks and give them back so that calloc may reuse them
+    for (int i = 0; i < 16; i++)
+    {
+        char* dirty = NULL;
+        GC_MALLOC(dirty, 256);
+        memset(dirty, 0xff, 256);
+        GC_FREE(dirty);
+    }
+
+    for (int i = 0; i < 16; i++)
+    {
+        char* mem = NULL;
+        GC_CALLOC(mem, 64, 4);
+        MU_ASSERT(mem != NULL, "GC_CALLOC failed to allocate memory");
+        for (int j = 0; j < 256; j++)
+        {
+            MU_ASSERT(mem[j] == 0, "GC_CALLOC returned dirty memory");
+        }
+    }
+
+    char* big = NULL;
+    GC_CALLOC(big, 1, 1024 * 1024);
+    MU_ASSERT(big != NULL && big[0] == 0 && big[1024 * 1024 - 1] == 0, "GC_CALLOC of a large block failed");
+
+    char* overflow = NULL;
+    errno = 0;
+    GC_CALLOC(overflow, SIZE_MAX / 2, 4);
+    MU_ASSERT(overflow == NULL && errno == ENOMEM, "GC_CALLOC did not detect size overflow");
+
+    GC_STOP();
+    return NULL;
+}
+
 // Test marking objects as roots
 char* test_gc_mark_root() {
     // Stopping to make sure a new garbage collector is going to be created
@@ -221,6 +312,918 @@ char* test_gc_thread_local_collection() {
     return NULL;
 }
 
+// Test that weak references do not keep objects alive and are cleared by sweep
+char* test_gc_weak_ref() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    int* ptr = NULL;
+    GC_MARK_ROOT(ptr);
+    GC_MALLOC(ptr, sizeof(int));
+    *ptr = 7;
+
+    gc_weak_ref* ref = GC_WEAK_CREATE(ptr);
+    MU_ASSERT(ref != NULL, "Failed to create weak reference");
+
+    // Object is still reachable from the root
+    GC_COLLECT(THREAD_LOCAL);
+    int* weak_ptr = GC_WEAK_GET(ref);
+    MU_ASSERT(weak_ptr == ptr && *weak_ptr == 7, "Weak reference to live object was cleared");
+
+    // Only the weak reference is left
+    ptr = NULL;
+    weak_ptr = NULL;
+    GC_COLLECT(THREAD_LOCAL);
+    weak_ptr = GC_WEAK_GET(ref);
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(weak_ptr == NULL, "Weak reference kept object alive");
+    MU_ASSERT(allocs_cnt == 0, "Weakly referenced object was not collected");
+
+    GC_WEAK_DESTROY(ref);
+    GC_UNMARK_ROOT(ptr);
+    GC_STOP();
+    return NULL;
+}
+
+static void fill_movable(gc_handle handle, char value, size_t size) {
+    memset(GC_DEREF(handle), value, size);
+}
+
+static int check_movable(gc_handle handle, char value, size_t size) {
+    char* mem = (char*)GC_DEREF(handle);
+    for (size_t i = 0; i < size; i++)
+    {
+        if (mem[i] != value) { return 0; }
+    }
+    return 1;
+}
+
+// Addresses are hidden from the conservative stack scan, which would pin the objects
+#define HIDE_ADDR(handle) ((size_t)GC_DEREF(handle) ^ 0x5a5a5a5aUL)
+
+// Test that a global collection slides live movable objects over the garbage, except pinned ones
+char* test_gc_movable_compaction() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    const size_t size = 4096;
+    gc_handle first = NULL;
+    gc_handle garbage = NULL;
+    gc_handle moved = NULL;
+    gc_handle hole = NULL;
+    gc_handle pinned = NULL;
+    GC_MARK_ROOT(first);
+    GC_MARK_ROOT(moved);
+    GC_MARK_ROOT(pinned);
+
+    GC_MALLOC_MOVABLE(first, size);
+    GC_MALLOC_MOVABLE(garbage, size);
+    GC_MALLOC_MOVABLE(moved, size);
+    GC_MALLOC_MOVABLE(hole, size);
+    GC_MALLOC_MOVABLE(pinned, size);
+    MU_ASSERT(first != NULL && garbage != NULL && moved != NULL && pinned != NULL, "GC_MALLOC_MOVABLE failed");
+
+    fill_movable(first, 'a', size);
+    fill_movable(moved, 'b', size);
+    fill_movable(pinned, 'c', size);
+    GC_PIN(pinned);
+
+    size_t garbage_addr = HIDE_ADDR(garbage);
+    size_t pinned_addr = HIDE_ADDR(pinned);
+    garbage = NULL;
+    hole = NULL;
+
+    GC_COLLECT(GLOBAL);
+
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == 3, "Movable garbage was not collected");
+    MU_ASSERT(HIDE_ADDR(moved) == garbage_addr, "Live movable object was not compacted");
+    MU_ASSERT(HIDE_ADDR(pinned) == pinned_addr, "Pinned movable object was moved");
+    MU_ASSERT(check_movable(first, 'a', size), "Movable object content corrupted");
+    MU_ASSERT(check_movable(moved, 'b', size), "Moved object content corrupted");
+    MU_ASSERT(check_movable(pinned, 'c', size), "Pinned object content corrupted");
+
+    GC_UNPIN(pinned);
+    GC_FREE(pinned);
+    allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == 2, "GC_FREE failed on movable object");
+
+    GC_UNMARK_ROOT(first);
+    GC_UNMARK_ROOT(moved);
+    GC_UNMARK_ROOT(pinned);
+    GC_STOP();
+    return NULL;
+}
+
+// Test that a time-budgeted cycle is sliced and keeps objects the mutator moved between slices
+static char* check_collect_budget(int flags) {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE_EX(flags);
+
+    const int nodes_cnt = 200;
+    test_node* head = NULL;
+    GC_MARK_ROOT(head);
+    GC_MALLOC(head, sizeof(test_node));
+    head->value = 0;
+    head->next = NULL;
+
+    test_node* prev = NULL;
+    test_node* current = head;
+    for (int i = 1; i < nodes_cnt; i++)
+    {
+        GC_MALLOC(current->next, sizeof(test_node));
+        prev = current;
+        current = current->next;
+        current->value = i;
+        current->next = NULL;
+    }
+
+    for (int i = 0; i < 100; i++)
+    {
+        test_node* garbage = NULL;
+        GC_MALLOC(garbage, sizeof(test_node));
+    }
+
+    // One object is scanned per slice at least, so the head is black and the rest is not scanned yet
+    int done = GC_COLLECT_BUDGET(THREAD_LOCAL, 1);
+    MU_ASSERT(done == 0, "Cycle finished within 1ns");
+
+    // Move the tail behind the already scanned head
+    test_node* tail = current;
+    prev->next = NULL;
+    tail->next = head->next;
+    head->next = tail;
+    prev = NULL;
+    current = NULL;
+    tail = NULL;
+
+    int steps = 1;
+    do {
+        done = GC_COLLECT_BUDGET(THREAD_LOCAL, 1);
+        steps++;
+    } while (done == 0 && steps < 100000);
+
+    MU_ASSERT(done == 1, "Budgeted cycle did not finish");
+    MU_ASSERT(steps > 2, "Budgeted cycle was not split into slices");
+
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == nodes_cnt, "Budgeted cycle collected live objects or kept garbage");
+    MU_ASSERT(head->next->value == nodes_cnt - 1, "Moved object was corrupted");
+
+    GC_UNMARK_ROOT(head);
+    GC_STOP();
+    return NULL;
+}
+
+char* test_gc_collect_budget() {
+    return check_collect_budget(0);
+}
+
+// Test that a block moved by realloc in the middle of a budgeted cycle is still scanned under its new address
+char* test_gc_collect_budget_realloc() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    const int slots_cnt = 64;
+    test_node** holder = NULL;
+    GC_MARK_ROOT(holder);
+    GC_MALLOC(holder, slots_cnt * sizeof(test_node*));
+    for (int i = 0; i < slots_cnt; i++)
+    {
+        GC_MALLOC(holder[i], sizeof(test_node));
+        holder[i]->value = i;
+        holder[i]->next = NULL;
+    }
+    // The only pointer to the child is in the first slot's object, whose neighbours are in use
+    GC_MALLOC(holder[0]->next, sizeof(test_node));
+    holder[0]->next->value = -1;
+    holder[0]->next->next = NULL;
+
+    // The holder is scanned by the first slice, the objects in its slots are still grey
+    int done = GC_COLLECT_BUDGET(THREAD_LOCAL, 1);
+    MU_ASSERT(done == 0, "Cycle finished within 1ns");
+
+    test_node* parent = holder[0];
+    test_node* old_parent = parent;
+    GC_REALLOC(parent, 4096);
+    MU_ASSERT(parent != NULL, "GC_REALLOC failed");
+    int moved = parent != old_parent;
+    holder[0] = parent;
+    parent = NULL;
+    old_parent = NULL;
+
+    int steps = 1;
+    do {
+        done = GC_COLLECT_BUDGET(THREAD_LOCAL, 1);
+        steps++;
+    } while (done == 0 && steps < 100000);
+    MU_ASSERT(done == 1, "Budgeted cycle did not finish");
+    MU_ASSERT(moved, "GC_REALLOC did not move the block");
+
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == slots_cnt + 2, "Object referenced from a moved block was collected");
+    MU_ASSERT(holder[0]->next->value == -1, "Object referenced from a moved block was corrupted");
+
+    GC_UNMARK_ROOT(holder);
+    GC_STOP();
+    return NULL;
+}
+
+// Test that a budgeted cycle finding written objects by soft-dirty pages keeps moved objects alive.
+// Where the kernel has no soft-dirty bits it falls back to content hashes and must behave the same.
+char* test_gc_collect_budget_dirty_pages() {
+    return check_collect_budget(GC_FLAG_DIRTY_PAGES);
+}
+
+// Test that the recorder writes one fixed-size record per operation
+char* test_gc_record() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    const char* path = "/tmp/gc_test.rec";
+    MU_ASSERT(gc_record_start(path) == 0, "Failed to start recording");
+
+    GC_CREATE();
+    char* ptr = NULL;
+    GC_MARK_ROOT(ptr);
+    GC_MALLOC(ptr, 32);
+    GC_COLLECT(THREAD_LOCAL);
+    GC_UNMARK_ROOT(ptr);
+    GC_STOP();
+    gc_record_stop();
+
+    // Allocations after stopping are not recorded
+    GC_CREATE();
+
+    FILE* in = fopen(path, "rb");
+    MU_ASSERT(in != NULL, "Record file was not created");
+    char magic[9] = {0};
+    size_t magic_len = fread(magic, 1, 8, in);
+    fseek(in, 0, SEEK_END);
+    long file_size = ftell(in);
+    fclose(in);
+    remove(path);
+
+    MU_ASSERT(magic_len == 8 && strcmp(magic, "GCREC001") == 0, "Wrong record header");
+    MU_ASSERT(file_size == 8 + 6 * 40, "Wrong number of records");
+
+    GC_STOP();
+    return NULL;
+}
+
+// Test that counted objects are freed without tracing once neither a count nor a root keeps them,
+// and that cycles of counted objects are left to the collection
+char* test_gc_rc() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    const int nodes_cnt = 10;
+    test_node* head = NULL;
+    GC_MARK_ROOT(head);
+    GC_MALLOC_RC(head, sizeof(test_node));
+    head->value = 0;
+    head->next = NULL;
+
+    test_node* current = head;
+    for (int i = 1; i < nodes_cnt; i++)
+    {
+        GC_MALLOC_RC(current->next, sizeof(test_node));
+        GC_RETAIN(current->next);
+        current = current->next;
+        current->value = i;
+        current->next = NULL;
+    }
+    current = NULL;
+
+    test_node* cycle = NULL;
+    GC_MARK_ROOT(cycle);
+    GC_MALLOC_RC(cycle, sizeof(test_node));
+    GC_MALLOC_RC(cycle->next, sizeof(test_node));
+    GC_RETAIN(cycle->next);
+    cycle->next->next = cycle;
+    GC_RETAIN(cycle);
+    cycle = NULL;
+
+    // The head has no count, the root alone keeps the list
+    unsigned long long int freed = GC_RC_FLUSH();
+    MU_ASSERT(freed == 0, "Counted objects held by a root or by a count were freed");
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == nodes_cnt + 2, "Counted objects were lost");
+
+    head = NULL;
+    freed = GC_RC_FLUSH();
+    MU_ASSERT(freed == nodes_cnt, "Unreferenced list was not freed by counting");
+    allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == 2, "Cycle of counted objects was freed by counting");
+
+    GC_COLLECT(THREAD_LOCAL);
+    allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == 0, "Cycle of counted objects was not collected");
+
+    GC_UNMARK_ROOT(cycle);
+    GC_UNMARK_ROOT(head);
+    GC_STOP();
+    return NULL;
+}
+
+// Test that region objects are released wholesale and that promoted ones survive
+char* test_gc_region() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    char* heap_obj = NULL;
+    GC_MALLOC(heap_obj, 16);
+    strcpy(heap_obj, "heap");
+
+    char* kept = NULL;
+    GC_MARK_ROOT(kept);
+
+    int ret = GC_REGION_BEGIN();
+    MU_ASSERT(ret == 0, "GC_REGION_BEGIN failed");
+
+    // The heap object is referenced only from region memory
+    void** holder = NULL;
+    GC_MALLOC(holder, sizeof(void*));
+    *holder = heap_obj;
+    heap_obj = NULL;
+
+    char* tmp = NULL;
+    for (int i = 0; i < 1000; i++)
+    {
+        GC_MALLOC(tmp, 32);
+        MU_ASSERT(tmp != NULL && tmp[0] == 0, "Region allocation failed");
+        snprintf(tmp, 32, "tmp %d", i);
+    }
+
+    // Only the start of a region object has a header to read its size from
+    errno = 0;
+    kept = GC_REGION_PROMOTE(tmp + 8);
+    MU_ASSERT(kept == NULL && errno == EINVAL, "GC_REGION_PROMOTE accepted an interior pointer");
+    char* interior = tmp + 8;
+    errno = 0;
+    GC_REALLOC(interior, 64);
+    MU_ASSERT(interior == NULL && errno == EINVAL, "GC_REALLOC accepted an interior pointer of a region object");
+
+    kept = GC_REGION_PROMOTE(tmp);
+    MU_ASSERT(kept != NULL && kept != tmp, "GC_REGION_PROMOTE failed");
+
+    GC_COLLECT(THREAD_LOCAL);
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == 2, "Region objects were put into the heap or heap object was collected");
+    MU_ASSERT(strcmp((char*)*holder, "heap") == 0, "Heap object referenced from region was corrupted");
+
+    ret = GC_REGION_END();
+    MU_ASSERT(ret == 0, "GC_REGION_END failed");
+    holder = NULL;
+    tmp = NULL;
+
+    MU_ASSERT(strcmp(kept, "tmp 999") == 0, "Promoted object was corrupted");
+
+    GC_COLLECT(THREAD_LOCAL);
+    allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == 1, "Only the promoted object has to stay alive");
+    MU_ASSERT(gc_get_live_bytes(pthread_self()) == 32, "Region bytes were not released");
+
+    errno = 0;
+    ret = GC_REGION_END();
+    MU_ASSERT(ret == -1 && errno == EINVAL, "GC_REGION_END without a region did not fail");
+
+    GC_UNMARK_ROOT(kept);
+    GC_STOP();
+    return NULL;
+}
+
+static void write_file(const char* path, const char* content) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) { return; }
+    fputs(content, file);
+    fclose(file);
+}
+
+static int wait_pressure_events(unsigned long long int cnt) {
+    for (int i = 0; i < 300; i++)
+    {
+        if (gc_pressure_events() >= cnt) { return 1; }
+        usleep(10000);
+    }
+    return 0;
+}
+
+// Test that the pressure monitor reacts to PSI averages and to the cgroup limit, read from stand-in files
+char* test_gc_pressure() {
+    char cgroup_dir[] = "/tmp/gc_test_pressure.XXXXXX";
+    MU_ASSERT(mkdtemp(cgroup_dir) != NULL, "Failed to create a directory for the stand-in files");
+    char psi_path[64];
+    char max_path[64];
+    char current_path[64];
+    snprintf(psi_path, sizeof(psi_path), "%s/pressure", cgroup_dir);
+    snprintf(max_path, sizeof(max_path), "%s/memory.max", cgroup_dir);
+    snprintf(current_path, sizeof(current_path), "%s/memory.current", cgroup_dir);
+
+    const char* calm = "some avg10=0.00 avg60=0.00 avg300=0.00 total=0\nfull avg10=0.00 avg60=0.00 avg300=0.00 total=0\n";
+    write_file(psi_path, calm);
+    write_file(max_path, "max\n");
+    write_file(current_path, "950\n");
+
+    unsigned long long int events = gc_pressure_events();
+    MU_ASSERT(gc_pressure_start(psi_path, cgroup_dir) == 0, "Failed to start pressure monitor");
+    MU_ASSERT(gc_pressure_start(psi_path, cgroup_dir) == -1 && errno == EBUSY, "Second monitor was started");
+
+    usleep(300000);
+    MU_ASSERT(gc_pressure_events() == events, "Pressure reported without pressure");
+
+    write_file(psi_path, "some avg10=42.00 avg60=10.00 avg300=2.00 total=100\nfull avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+    MU_ASSERT(wait_pressure_events(events + 1), "PSI average did not trigger a collection");
+    write_file(psi_path, calm);
+
+    // memory.current is 95% of memory.max
+    events = gc_pressure_events();
+    write_file(max_path, "1000\n");
+    MU_ASSERT(wait_pressure_events(events + 1), "cgroup limit did not trigger a collection");
+
+    gc_pressure_stop();
+    remove(psi_path);
+    remove(max_path);
+    remove(current_path);
+    rmdir(cgroup_dir);
+    return NULL;
+}
+
+static test_node* global_cache = NULL;
+
+// Test that globals are roots of a heap created with GC_FLAG_SCAN_DATA
+char* test_gc_scan_data() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE_EX(GC_FLAG_SCAN_DATA);
+
+    GC_MALLOC(global_cache, sizeof(test_node));
+    MU_ASSERT(global_cache != NULL, "GC_MALLOC failed to allocate memory");
+    global_cache->value = 42;
+    GC_MALLOC(global_cache->next, sizeof(test_node));
+    MU_ASSERT(global_cache->next != NULL, "GC_MALLOC failed to allocate memory");
+    global_cache->next->value = 43;
+    global_cache->next->next = NULL;
+
+    int allocs_cnt_before = GC_GET_ALLOCS_CNT();
+    GC_COLLECT(THREAD_LOCAL);
+    int allocs_cnt_after = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt_after == allocs_cnt_before, "Objects referenced from a global were collected");
+    MU_ASSERT(global_cache->value == 42 && global_cache->next->value == 43, "Objects referenced from a global were corrupted");
+
+    global_cache = NULL;
+    GC_COLLECT(THREAD_LOCAL);
+    allocs_cnt_after = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt_before - allocs_cnt_after == 2, "Objects no longer referenced from a global were not collected");
+
+    // Nor does counting free an object referenced from a global only
+    GC_MALLOC_RC(global_cache, sizeof(test_node));
+    global_cache->value = 44;
+    unsigned long long int freed = GC_RC_FLUSH();
+    MU_ASSERT(freed == 0 && global_cache->value == 44, "Counted object referenced from a global was freed");
+    global_cache = NULL;
+    GC_STOP();
+
+    // The background collector scans the globals of the owner it stopped as well
+    GC_CREATE_EX(GC_FLAG_SCAN_DATA | GC_FLAG_BACKGROUND);
+    GC_MALLOC(global_cache, sizeof(test_node));
+    global_cache->value = 45;
+    for (int i = 0; i < 10; i++)
+    {
+        test_node* garbage = NULL;
+        GC_MALLOC(garbage, sizeof(test_node));
+    }
+
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    for (int i = 0; i < 200 && allocs_cnt > 1; i++)
+    {
+        usleep(10000);
+        allocs_cnt = GC_GET_ALLOCS_CNT();
+    }
+    MU_ASSERT(allocs_cnt == 1, "Background collector did not keep exactly the object referenced from a global");
+    MU_ASSERT(global_cache->value == 45, "Object referenced from a global was corrupted");
+    global_cache = NULL;
+
+    GC_STOP();
+    return NULL;
+}
+
+// Test that the library names its configuration, and that byte-wise scanning configurations find
+// pointers at unaligned offsets
+char* test_gc_config() {
+    const char* config = gc_get_config();
+    int byte_scan = strcmp(config, "default") == 0 || strcmp(config, "debug") == 0;
+    MU_ASSERT(byte_scan || strcmp(config, "throughput") == 0 || strcmp(config, "low-latency") == 0,
+              "Unknown collector configuration");
+
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    char* holder = NULL;
+    GC_MALLOC(holder, 2 * sizeof(void*));
+    MU_ASSERT(holder != NULL, "GC_MALLOC failed to allocate memory");
+    GC_MARK_ROOT(holder);
+
+    int* child = NULL;
+    GC_MALLOC(child, sizeof(int));
+    MU_ASSERT(child != NULL, "GC_MALLOC failed to allocate memory");
+    memcpy(holder + 1, &child, sizeof(child));
+    child = NULL;
+
+    int allocs_cnt_before = GC_GET_ALLOCS_CNT();
+    GC_COLLECT(THREAD_LOCAL);
+    int allocs_cnt_after = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt_before - allocs_cnt_after == (byte_scan ? 0 : 1),
+              "Unaligned pointer was not scanned as the configuration says");
+
+    GC_UNMARK_ROOT(holder);
+    GC_STOP();
+    return NULL;
+}
+
+// Test that latency of the entry points is recorded per part while instrumentation is on
+char* test_gc_latency() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    MU_ASSERT(gc_latency_bucket_limit(7) == 7 && gc_latency_bucket_limit(15) == 15 &&
+              gc_latency_bucket_limit(16) == 17, "Wrong latency bucket limits");
+
+    MU_ASSERT(gc_latency_start() == 0, "Failed to start latency instrumentation");
+    for (int i = 0; i < 100; i++)
+    {
+        char* garbage = NULL;
+        GC_MALLOC(garbage, 32);
+    }
+    GC_COLLECT(THREAD_LOCAL);
+    gc_latency_stop();
+
+    char* untimed = NULL;
+    GC_MALLOC(untimed, 32);
+
+    gc_latency_hist hist;
+    int ret = gc_latency_snapshot(GC_OP_MALLOC, GC_LATENCY_TOTAL, &hist);
+    MU_ASSERT(ret == 0 && hist.count == 100, "Wrong number of timed GC_MALLOC calls");
+    unsigned long long int median = gc_latency_percentile(&hist, 0.5);
+    MU_ASSERT(median > 0 && median <= hist.max_ns && hist.sum_ns >= hist.max_ns, "Wrong GC_MALLOC latency");
+
+    ret = gc_latency_snapshot(GC_OP_MALLOC, GC_LATENCY_QUEUED, &hist);
+    MU_ASSERT(ret == 0 && hist.count == 100, "Queue time was not recorded");
+
+    gc_latency_hist total;
+    gc_latency_snapshot(GC_OP_COLLECT, GC_LATENCY_TOTAL, &total);
+    ret = gc_latency_snapshot(GC_OP_COLLECT, GC_LATENCY_COLLECT, &hist);
+    MU_ASSERT(ret == 0 && hist.count == 1 && hist.sum_ns > 0 && hist.sum_ns <= total.sum_ns,
+              "Collection time was not recorded");
+
+    ret = gc_latency_snapshot(GC_OP_CNT, GC_LATENCY_TOTAL, &hist);
+    MU_ASSERT(ret == -1 && errno == EINVAL, "Unknown operation was accepted");
+
+    GC_STOP();
+    return NULL;
+}
+
+static void count_census_heap(pthread_t tid, const gc_census* census, void* arg) {
+    if (pthread_equal(tid, pthread_self())) { *(unsigned long long int*)arg = census->objects; }
+}
+
+// Test that the census counts the survivors of a collection by size class and can be dumped
+char* test_gc_census() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    void** table = NULL;
+    GC_MARK_ROOT(table);
+    GC_CALLOC(table, 20, sizeof(void*));
+    for (int i = 0; i < 10; i++)
+    {
+        GC_MALLOC(table[i], 24);
+    }
+    GC_MALLOC(table[10], GC_CENSUS_LARGE_BYTES);
+    for (int i = 0; i < 9; i++)
+    {
+        char* garbage = NULL;
+        GC_MALLOC(garbage, 24);
+    }
+    gc_handle handle = NULL;
+    GC_MARK_ROOT(handle);
+    GC_MALLOC_MOVABLE(handle, 100);
+
+    GC_COLLECT(THREAD_LOCAL);
+
+    gc_census census;
+    int ret = gc_heap_census(pthread_self(), &census, NULL, NULL);
+    MU_ASSERT(ret == 0, "gc_heap_census failed");
+    MU_ASSERT(census.objects == 12 && census.class_objects[1] == 10, "Wrong survivor count or size class");
+    MU_ASSERT(census.bytes == 20 * sizeof(void*) + 240 + GC_CENSUS_LARGE_BYTES, "Wrong survivor bytes");
+    MU_ASSERT(census.large_objects == 1, "Large object was not counted");
+    MU_ASSERT(census.movable_objects == 1 && census.movable_bytes == 100, "Movable object was not counted");
+    MU_ASSERT(census.arena_bytes > 0 && census.arena_pages[1] == 1, "Arena occupancy was not counted");
+
+    unsigned long long int own_objects = 0;
+    ret = gc_heap_census(GC_ALL_HEAPS, NULL, count_census_heap, &own_objects);
+    MU_ASSERT(ret == 0 && own_objects == 12, "Heap was not visited");
+
+    const char* path = "/tmp/gc_census_test.json";
+    MU_ASSERT(gc_census_dump(path, GC_CENSUS_JSON) == 0, "Failed to dump census");
+    FILE* file = fopen(path, "r");
+    MU_ASSERT(file != NULL, "Census file was not written");
+    char header[16] = {0};
+    MU_ASSERT(fgets(header, sizeof(header), file) != NULL, "Census file is empty");
+    fclose(file);
+    remove(path);
+    MU_ASSERT(strncmp(header, "{\"heaps\":[", 10) == 0, "Census is not JSON");
+
+    GC_UNMARK_ROOT(handle);
+    GC_UNMARK_ROOT(table);
+    GC_STOP();
+    return NULL;
+}
+
+// Test that the profiler reports live and total bytes of sampled allocation sites
+char* test_gc_profiler() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    const char* path = "gc_profile_test.heap";
+    // Sampling every byte makes every allocation a sample
+    MU_ASSERT(gc_profiler_start(1, path) == 0, "Failed to start profiler");
+
+    int* live = NULL;
+    GC_MARK_ROOT(live);
+    GC_MALLOC(live, 100);
+    int* garbage = NULL;
+    GC_MALLOC(garbage, 50);
+    garbage = NULL;
+
+    GC_COLLECT(THREAD_LOCAL);
+    gc_profiler_stop();
+
+    FILE* file = fopen(path, "r");
+    MU_ASSERT(file != NULL, "Profile was not reported after collection");
+    char header[256];
+    MU_ASSERT(fgets(header, sizeof(header), file) != NULL, "Profile is empty");
+    fclose(file);
+    remove(path);
+
+    MU_ASSERT(strcmp(header, "heap profile: 1: 100 [2: 150] @ heap_v2/1\n") == 0, "Wrong live or total bytes in profile");
+
+    GC_UNMARK_ROOT(live);
+    GC_STOP();
+    return NULL;
+}
+
+// Test moving an object graph to the orphan heap and claiming it back
+char* test_gc_transfer() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    test_node* head = NULL;
+    GC_MALLOC(head, sizeof(test_node));
+    head->value = 1;
+    head->next = NULL;
+    GC_MALLOC(head->next, sizeof(test_node));
+    head->next->value = 2;
+    head->next->next = NULL;
+
+    int allocs_before = GC_GET_ALLOCS_CNT();
+    long long int moved = gc_transfer(pthread_self(), GC_ORPHAN_HEAP, head);
+    int allocs_after = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(moved == 2, "gc_transfer did not move the whole graph");
+    MU_ASSERT(allocs_before - allocs_after == 2, "Transferred objects are still owned by the thread heap");
+
+    // The orphan heap keeps the graph alive until it is claimed
+    GC_COLLECT(GLOBAL);
+    MU_ASSERT(gc_get_allocs_cnt(GC_ORPHAN_HEAP) == 2, "Orphan heap lost transferred objects");
+
+    moved = gc_transfer(GC_ORPHAN_HEAP, pthread_self(), head);
+    MU_ASSERT(moved == 2, "Failed to claim objects from the orphan heap");
+    MU_ASSERT(gc_get_allocs_cnt(GC_ORPHAN_HEAP) == 0, "Claimed objects are still in the orphan heap");
+
+    GC_MARK_ROOT(head);
+    GC_COLLECT(THREAD_LOCAL);
+    allocs_after = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_after == allocs_before, "Claimed objects were not adopted");
+    MU_ASSERT(head->value == 1 && head->next->value == 2, "Transferred graph was corrupted");
+
+    GC_UNMARK_ROOT(head);
+    GC_STOP();
+    return NULL;
+}
+
+static test_node* adopted_node = NULL;
+static int foreign_heap_refused = 0;
+
+void* adopt_thread_func(void* arg) {
+    GC_CREATE();
+    GC_MALLOC(adopted_node, sizeof(test_node));
+    adopted_node->value = 42;
+
+    // The heap of another running thread cannot be changed
+    pthread_t parent = *(pthread_t*)arg;
+    foreign_heap_refused = gc_transfer(parent, pthread_self(), adopted_node) == -1 && errno == EINVAL &&
+                           gc_adopt_on_stop(parent, pthread_self()) == -1 && errno == EINVAL;
+
+    gc_adopt_on_stop(pthread_self(), parent);
+    GC_STOP();
+    return NULL;
+}
+
+// Test that a stopping thread hands its objects over instead of freeing them
+char* test_gc_adopt_on_stop() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+    GC_MARK_ROOT(adopted_node);
+
+    pthread_t self = pthread_self();
+    pthread_t thread;
+    MU_ASSERT(pthread_create(&thread, NULL, adopt_thread_func, &self) == 0, "pthread_create failed");
+    MU_ASSERT(pthread_join(thread, NULL) == 0, "pthread_join failed");
+    MU_ASSERT(foreign_heap_refused, "Heap of another thread was changed");
+
+    GC_COLLECT(THREAD_LOCAL);
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == 1, "Object of the stopped thread was not adopted");
+    MU_ASSERT(adopted_node->value == 42, "Adopted object was corrupted");
+
+    GC_UNMARK_ROOT(adopted_node);
+    GC_STOP();
+    return NULL;
+}
+
+void* exiting_thread_func(void* arg) {
+    GC_CREATE();
+    char* data = NULL;
+    GC_MARK_ROOT(data);
+    GC_MALLOC(data, 4096);
+    *(unsigned long long int*)arg = gc_get_live_bytes(pthread_self());
+    // No GC_STOP, the heap has to be stopped when the thread exits
+    return NULL;
+}
+
+// Test that heaps of exited threads are released and reused by new threads
+char* test_gc_thread_exit() {
+    unsigned long long int live_before = gc_get_process_live_bytes();
+
+    for (int i = 0; i < 4; i++)
+    {
+        unsigned long long int thread_live = 0;
+        pthread_t thread;
+        MU_ASSERT(pthread_create(&thread, NULL, exiting_thread_func, &thread_live) == 0, "pthread_create failed");
+        MU_ASSERT(pthread_join(thread, NULL) == 0, "pthread_join failed");
+
+        // A reused heap starts empty
+        MU_ASSERT(thread_live == 4096, "Heap of a new thread was not empty");
+        MU_ASSERT(gc_get_process_live_bytes() == live_before, "Heap of an exited thread was not released");
+    }
+    return NULL;
+}
+
+// Test that a snapshot collection frees unreachable objects without stopping the heap for marking
+char* test_gc_snapshot_collection() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+    test_node* head = NULL;
+    GC_MARK_ROOT(head);
+    GC_MALLOC(head, sizeof(test_node));
+    head->value = 1;
+    GC_MALLOC(head->next, sizeof(test_node));
+    head->next->value = 2;
+    head->next->next = NULL;
+
+    for (int i = 0; i < 100; i++)
+    {
+        test_node* garbage = NULL;
+        GC_MALLOC(garbage, sizeof(test_node));
+    }
+
+    // Unreachable, but GC_WEAK_GET may hand it out until a lazy free, so the snapshot leaves it alone
+    test_node* weak_target = NULL;
+    GC_MALLOC(weak_target, sizeof(test_node));
+    weak_target->value = 3;
+    gc_weak_ref* ref = GC_WEAK_CREATE(weak_target);
+    weak_target = NULL;
+
+    GC_COLLECT(GLOBAL_SNAPSHOT);
+
+    // Garbage is freed by an operation on the heap once the snapshot process has reported it
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    for (int i = 0; i < 500 && allocs_cnt != 3; i++)
+    {
+        usleep(10000);
+        GC_FREE(NULL);
+        allocs_cnt = GC_GET_ALLOCS_CNT();
+    }
+    MU_ASSERT(allocs_cnt == 3, "Snapshot collection did not free unreachable objects");
+    MU_ASSERT(head->value == 1 && head->next->value == 2, "Reachable objects were corrupted");
+    test_node* weak_ptr = GC_WEAK_GET(ref);
+    MU_ASSERT(weak_ptr != NULL && weak_ptr->value == 3, "Snapshot collection freed a weakly referenced object");
+
+    // A regular collection clears the weak reference before freeing the object
+    weak_ptr = NULL;
+    GC_COLLECT(THREAD_LOCAL);
+    weak_ptr = GC_WEAK_GET(ref);
+    MU_ASSERT(weak_ptr == NULL, "Weak reference to collected object was not cleared");
+    GC_WEAK_DESTROY(ref);
+
+    GC_UNMARK_ROOT(head);
+    GC_STOP();
+    return NULL;
+}
+
+static int thp_enabled() {
+    FILE* in = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (in == NULL) { return 0; }
+    char buf[128];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, in);
+    fclose(in);
+    buf[len] = '\0';
+    return strstr(buf, "[never]") == NULL;
+}
+
+// Test that arenas of a heap created with GC_FLAG_HUGE_PAGES are backed by huge pages when THP is available
+char* test_gc_huge_pages() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+    gc_handle handle = NULL;
+    GC_MARK_ROOT(handle);
+    GC_MALLOC_MOVABLE(handle, 4096);
+    unsigned long long int huge_bytes = gc_get_huge_page_bytes(pthread_self());
+    MU_ASSERT(huge_bytes == 0, "Huge pages used without GC_FLAG_HUGE_PAGES");
+    GC_UNMARK_ROOT(handle);
+    GC_STOP();
+
+    GC_CREATE_EX(GC_FLAG_HUGE_PAGES);
+    GC_MARK_ROOT(handle);
+    GC_MALLOC_MOVABLE(handle, 4096);
+    MU_ASSERT(handle != NULL, "GC_MALLOC_MOVABLE failed");
+    memset(GC_DEREF(handle), 'h', 4096);
+
+    int ret = GC_REGION_BEGIN();
+    MU_ASSERT(ret == 0, "GC_REGION_BEGIN failed");
+    char* tmp = NULL;
+    GC_MALLOC(tmp, 1024);
+    MU_ASSERT(tmp != NULL, "Region allocation failed");
+    memset(tmp, 't', 1024);
+
+    huge_bytes = gc_get_huge_page_bytes(pthread_self());
+    if (thp_enabled())
+    {
+        MU_ASSERT(huge_bytes >= 2 * 2 * 1024 * 1024, "Arenas are not backed by huge pages");
+    } else
+    {
+        MU_ASSERT(huge_bytes == 0, "Huge pages reported while THP is disabled");
+    }
+
+    ret = GC_REGION_END();
+    MU_ASSERT(ret == 0, "GC_REGION_END failed");
+    GC_COLLECT(THREAD_LOCAL);
+    MU_ASSERT(((char*)GC_DEREF(handle))[4095] == 'h', "Movable object corrupted");
+
+    GC_UNMARK_ROOT(handle);
+    GC_STOP();
+    return NULL;
+}
+
+// Sleeps the whole interval even when SIGUSR1 of a global collection interrupts it
+static void sleep_ms(long ms) {
+    struct timespec left = {ms / 1000, (ms % 1000) * 1000000};
+    while (nanosleep(&left, &left) != 0 && errno == EINTR) {}
+}
+
+// Workers have allocated before the first count, and stay alive until the second one
+static pthread_barrier_t allocated_barrier;
+static pthread_barrier_t counted_barrier;
+
 // Function for worker threads
 void* thread_func(void* arg) {
     gc_handler handler = gc_create(pthread_self());
@@ -231,9 +1234,11 @@ void* thread_func(void* arg) {
     {
         handler.gc_malloc(pthread_self(), (void**)&val, 4);
         *val = 123;
-        usleep(200000);     // 200ms
+        sleep_ms(200);
     }
-    
+
+    pthread_barrier_wait(&allocated_barrier);
+    pthread_barrier_wait(&counted_barrier);
     gc_stop(pthread_self());
     return NULL;
 }
@@ -245,6 +1250,8 @@ char* test_gc_global_collection() {
 
     const int num_thread = 9;
     pthread_t threads[num_thread];
+    pthread_barrier_init(&allocated_barrier, NULL, num_thread + 1);
+    pthread_barrier_init(&counted_barrier, NULL, num_thread + 1);
 
     for (size_t i = 0; i < num_thread; i++)
     {
@@ -257,7 +1264,7 @@ char* test_gc_global_collection() {
 
 
     gc_handler handler = gc_create(pthread_self());
-    usleep(500000);     // 200ms
+    pthread_barrier_wait(&allocated_barrier);
 
     int allocs_before = gc_gel_all_threads_allocs_cnt();
 
@@ -265,9 +1272,7 @@ char* test_gc_global_collection() {
     handler.collect(pthread_self(), GLOBAL);
 
     int allocs_after = gc_gel_all_threads_allocs_cnt();
-
-    // Check that 18 allocations were collected by gc
-    MU_ASSERT(allocs_before - allocs_after == 18, "Multi-threaded gc failed");
+    pthread_barrier_wait(&counted_barrier);
 
     GC_STOP();
 
@@ -280,6 +1285,11 @@ char* test_gc_global_collection() {
             return NULL;
         }   
     }
+    pthread_barrier_destroy(&allocated_barrier);
+    pthread_barrier_destroy(&counted_barrier);
+
+    // Check that 18 allocations were collected by gc
+    MU_ASSERT(allocs_before - allocs_after == 18, "Multi-threaded gc failed");
     
     return NULL;
 }
@@ -313,6 +1323,38 @@ char* test_gc_background_collection() {
     return NULL;
 }
 
+// Test that the background collector thread collects an idle heap
+char* test_gc_background_thread() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE_EX(GC_FLAG_BACKGROUND);
+
+    char* live = NULL;
+    GC_MARK_ROOT(live);
+    GC_MALLOC(live, 64);
+
+    for (int i = 0; i < 10; i++)
+    {
+        char* garbage = NULL;
+        GC_MALLOC(garbage, 16);
+    }
+
+    // Being idle, the heap has to be collected without any call from this thread.
+    // Sleeping is interrupted when the thread is stopped for the collection.
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    for (int i = 0; i < 200 && allocs_cnt != 1; i++)
+    {
+        usleep(10000);
+        allocs_cnt = GC_GET_ALLOCS_CNT();
+    }
+    MU_ASSERT(allocs_cnt == 1, "Background collector did not collect idle heap");
+
+    GC_UNMARK_ROOT(live);
+    GC_STOP();
+    return NULL;
+}
+
 // Large allocation test
 char* test_gc_large_allocation() {
     // Stopping to make sure a new garbage collector is going to be created
@@ -372,6 +1414,65 @@ char* test_gc_stress() {
     return NULL;
 }
 
+// Test that the heap hard budget collects first and then refuses the allocation
+char* test_gc_budget() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+    MU_ASSERT(gc_set_budget(pthread_self(), 0, 1000) == 0, "Failed to set heap budget");
+
+    char* live = NULL;
+    GC_MARK_ROOT(live);
+    GC_MALLOC(live, 600);
+    MU_ASSERT(live != NULL, "Allocation under the budget failed");
+
+    char* over = (char*)1;
+    errno = 0;
+    GC_MALLOC(over, 600);
+    MU_ASSERT(over == NULL && errno == GC_EBUDGET, "Allocation over the hard budget did not fail with GC_EBUDGET");
+
+    // Once the first block is garbage, the budget check collects it and the allocation fits
+    live = NULL;
+    GC_MALLOC(over, 600);
+    MU_ASSERT(over != NULL, "Budget check did not collect garbage");
+    MU_ASSERT(gc_get_live_bytes(pthread_self()) == 600, "Wrong live bytes");
+
+    // Same for the process-wide budget, with the live block kept reachable
+    live = over;
+    MU_ASSERT(gc_set_budget(pthread_self(), 0, 0) == 0, "Failed to reset heap budget");
+    MU_ASSERT(gc_set_process_budget(0, gc_get_process_live_bytes() + 100) == 0, "Failed to set process budget");
+    over = (char*)1;
+    errno = 0;
+    GC_MALLOC(over, 600);
+    MU_ASSERT(over == NULL && errno == GC_EBUDGET, "Allocation over the process hard budget did not fail");
+
+    // A failed realloc keeps the old block over the global collection run before its retry
+    char* unrooted = NULL;
+    MU_ASSERT(gc_set_process_budget(0, 0) == 0, "Failed to reset process budget");
+    GC_MALLOC(unrooted, 16);
+    MU_ASSERT(gc_set_process_budget(0, gc_get_process_live_bytes() + 100) == 0, "Failed to set process budget");
+    int allocs_cnt_before = GC_GET_ALLOCS_CNT();
+    errno = 0;
+    GC_REALLOC(unrooted, 600);
+    int allocs_cnt_after = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(unrooted != NULL && errno == GC_EBUDGET, "Realloc over the process hard budget did not fail");
+    MU_ASSERT(allocs_cnt_after == allocs_cnt_before, "Old block of a failed realloc was freed");
+    GC_FREE(unrooted);
+
+    // The global collection run for the soft budget keeps the block it was run for
+    MU_ASSERT(gc_set_process_budget(gc_get_process_live_bytes() + 100, 0) == 0, "Failed to set process budget");
+    allocs_cnt_before = GC_GET_ALLOCS_CNT();
+    GC_MALLOC(over, 600);
+    allocs_cnt_after = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(over != NULL && allocs_cnt_after == allocs_cnt_before + 1, "Block allocated over the process soft budget was freed");
+    MU_ASSERT(gc_set_process_budget(0, 0) == 0, "Failed to reset process budget");
+
+    GC_UNMARK_ROOT(live);
+    GC_STOP();
+    return NULL;
+}
+
 // Test passing invalid argument to gc_handler
 char* test_gc_passing_inval() {
     // Stopping to make sure a new garbage collector is going to be created
@@ -408,6 +1509,39 @@ char* test_gc_passing_inval() {
     return NULL;
 }
 
+// Test that tracing writes GC phases in Chrome trace-event format
+char* test_gc_trace() {
+    // Stopping to make sure a new garbage collector is going to be created
+    GC_STOP();
+
+    GC_CREATE();
+
+    const char* path = "gc_trace_test.json";
+    MU_ASSERT(gc_trace_start(path, GC_TRACE_OBJECTS) == 0, "Failed to start trace");
+
+    int* ptr = NULL;
+    GC_MALLOC(ptr, sizeof(int));
+    ptr = NULL;
+    GC_COLLECT(THREAD_LOCAL);
+
+    gc_trace_stop();
+
+    FILE* file = fopen(path, "r");
+    MU_ASSERT(file != NULL, "Trace file was not created");
+    char buf[4096];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, file);
+    buf[len] = '\0';
+    fclose(file);
+    remove(path);
+
+    MU_ASSERT(strncmp(buf, "{\"traceEvents\":[", 16) == 0, "Trace file has wrong format");
+    MU_ASSERT(strstr(buf, "\"name\":\"sweep\",\"cat\":\"gc\",\"ph\":\"B\"") != NULL, "Sweep phase was not traced");
+    MU_ASSERT(strstr(buf, "\"name\":\"sweep_object\"") != NULL, "Swept object was not traced");
+
+    GC_STOP();
+    return NULL;
+}
+
 int tests_run = 0;
 
 static char* basic_functionality_test_suite() {
@@ -415,6 +1549,8 @@ static char* basic_functionality_test_suite() {
     MU_RUN_TEST(test_gc_init_shutdown);
     MU_RUN_TEST(test_gc_malloc);
     MU_RUN_TEST(test_gc_malloc_free);
+    MU_RUN_TEST(test_gc_realloc);
+    MU_RUN_TEST(test_gc_calloc);
     MU_RUN_TEST(test_gc_mark_root);
     MU_RUN_TEST(test_gc_complex_objects);
 
@@ -425,8 +1561,18 @@ static char* collection_test_suite() {
     // Collection tests
     MU_RUN_TEST(test_gc_unmark_root);
     MU_RUN_TEST(test_gc_thread_local_collection);
+    MU_RUN_TEST(test_gc_collect_budget);
+    MU_RUN_TEST(test_gc_collect_budget_dirty_pages);
+    MU_RUN_TEST(test_gc_collect_budget_realloc);
     MU_RUN_TEST(test_gc_global_collection);
     MU_RUN_TEST(test_gc_background_collection);
+    MU_RUN_TEST(test_gc_background_thread);
+    MU_RUN_TEST(test_gc_weak_ref);
+    MU_RUN_TEST(test_gc_transfer);
+    MU_RUN_TEST(test_gc_adopt_on_stop);
+    MU_RUN_TEST(test_gc_snapshot_collection);
+    MU_RUN_TEST(test_gc_thread_exit);
+    MU_RUN_TEST(test_gc_scan_data);
 
     return NULL;
 }
@@ -435,6 +1581,17 @@ static char* advanced_test_suite() {
     // Advanced tests
     MU_RUN_TEST(test_gc_large_allocation);
     MU_RUN_TEST(test_gc_stress);
+    MU_RUN_TEST(test_gc_trace);
+    MU_RUN_TEST(test_gc_movable_compaction);
+    MU_RUN_TEST(test_gc_profiler);
+    MU_RUN_TEST(test_gc_census);
+    MU_RUN_TEST(test_gc_latency);
+    MU_RUN_TEST(test_gc_pressure);
+    MU_RUN_TEST(test_gc_record);
+    MU_RUN_TEST(test_gc_region);
+    MU_RUN_TEST(test_gc_rc);
+    MU_RUN_TEST(test_gc_huge_pages);
+    MU_RUN_TEST(test_gc_config);
 
     return NULL;
 }
@@ -442,6 +1599,7 @@ static char* advanced_test_suite() {
 static char* error_handling_test_suite() {
     // Error handling tests
     MU_RUN_TEST(test_gc_passing_inval);
+    MU_RUN_TEST(test_gc_budget);
 
     return NULL;
 }
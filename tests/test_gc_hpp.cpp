@@ -0,0 +1,102 @@
+#include "gc/gc.hpp"
+#include "gc/minunit.h"
+#include <pthread.h>
+
+struct test_list {
+    int value;
+    gc::ptr<test_list> next;
+};
+
+struct test_pair {
+    long first;
+    long second;
+};
+
+template<>
+struct gc::is_pointer_free<test_pair> : std::true_type {};
+
+// Test that roots keep objects alive and dropping them makes the objects garbage
+const char* test_gc_hpp_roots() {
+    gc::thread_heap heap;
+
+    {
+        gc::root<test_list> head = gc::make<test_list>(0, nullptr);
+        MU_ASSERT(head && head->value == 0, "gc::make failed");
+
+        test_list* tail = head.get();
+        for (int i = 1; i < 10; i++)
+        {
+            tail->next = gc::make<test_list>(i, nullptr);
+            tail = tail->next.get();
+        }
+
+        gc::collect();
+        int allocs_cnt = GC_GET_ALLOCS_CNT();
+        MU_ASSERT(allocs_cnt == 10, "Objects reachable from a root were collected");
+        MU_ASSERT(head->next->next->value == 2, "Object content corrupted");
+
+        // Root transfer by move keeps the objects rooted
+        gc::root<test_list> moved = std::move(head);
+        MU_ASSERT(!head && moved->value == 0, "Move did not transfer the root");
+        gc::collect();
+        allocs_cnt = GC_GET_ALLOCS_CNT();
+        MU_ASSERT(allocs_cnt == 10, "Moved root does not keep objects alive");
+    }
+
+    gc::collect();
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == 0, "Objects were kept alive by destroyed roots");
+    return NULL;
+}
+
+// Test allocation of pointer-free objects and arrays
+const char* test_gc_hpp_make() {
+    gc::thread_heap heap;
+
+    gc::root<test_pair> pair = gc::make<test_pair>(test_pair{1, 2});
+    MU_ASSERT(pair && pair->first == 1 && pair->second == 2, "gc::make of pointer-free type failed");
+
+    gc::root<double> numbers = gc::make_array<double>(100);
+    MU_ASSERT(numbers && numbers[99] == 0.0, "gc::make_array failed");
+
+    gc::root<gc::ptr<test_list>> table = gc::make_array<gc::ptr<test_list>>(4);
+    table[2] = gc::make<test_list>(7, nullptr);
+
+    gc::collect();
+    int allocs_cnt = GC_GET_ALLOCS_CNT();
+    MU_ASSERT(allocs_cnt == 4, "Objects reachable from an array were collected");
+    MU_ASSERT(table[2]->value == 7, "Array element content corrupted");
+    return NULL;
+}
+
+int tests_run = 0;
+
+static const char* cpp_api_test_suite() {
+    MU_RUN_TEST(test_gc_hpp_roots);
+    MU_RUN_TEST(test_gc_hpp_make);
+
+    return NULL;
+}
+
+int main() {
+    printf("=====[ GC C++ API tests ]=====\n");
+
+    const char* result = cpp_api_test_suite();
+    printf("C++ API: ");
+    if (result)
+    {
+        printf("FAILED\n\t%s\n", result);
+    } else
+    {
+        printf("OK\n");
+    }
+
+    printf("==============================\n");
+    if (!result)
+    {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+
+    return result != NULL;
+}
@@ -0,0 +1,278 @@
+// Replays a record written by gc_record_start() against the library and reports throughput and pauses.
+//
+//     gc_replay <record file>
+//
+// Every recorded thread gets a helper thread that owns its heap. Heaps are created and stopped on their
+// helper, so each is bound to its own thread's stack and NUMA node like in the recording. The other
+// operations are issued from the main thread in the recorded order. Pointers stored inside objects are not
+// recorded, so objects are kept alive only by the recorded root variables.
+
+#include "gc/gc.h"
+#include "gc/recorder.h"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <time.h>
+
+#define RECORD_KINDS_CNT 9
+
+static const char* kind_name[RECORD_KINDS_CNT] = {
+    "create", "stop", "malloc", "calloc", "realloc", "free", "mark_root", "unmark_root", "collect"
+};
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Threads that own heaps. They run the tasks handed to them with run(), and otherwise only wait, alive to
+// be stopped by global collections.
+class helper_threads {
+private:
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    bool done_ = false;
+    std::vector<std::function<void()>> tasks_;
+    std::vector<std::thread> threads_;
+    std::vector<pthread_t> tids_;
+
+public:
+    explicit helper_threads(size_t cnt) : tasks_(cnt) {
+        for (size_t i = 0; i < cnt; i++)
+        {
+            threads_.emplace_back([this, i]() {
+                std::unique_lock lock(mtx_);
+                while (true)
+                {
+                    cv_.wait(lock, [this, i]() { return done_ || tasks_[i]; });
+                    if (!tasks_[i]) { return; }
+
+                    auto task = tasks_[i];
+                    lock.unlock();
+                    task();
+                    lock.lock();
+                    tasks_[i] = nullptr;
+                    cv_.notify_all();
+                }
+            });
+            tids_.push_back(threads_.back().native_handle());
+        }
+    }
+
+    pthread_t tid(uint32_t idx) {
+        return tids_[idx];
+    }
+
+    // Runs `task` on helper `idx` and waits for it. Returns the time the task took, without the hand-off.
+    uint64_t run(uint32_t idx, const std::function<void()>& task) {
+        uint64_t task_ns = 0;
+        std::unique_lock lock(mtx_);
+        tasks_[idx] = [&task, &task_ns]() {
+            uint64_t begin = now_ns();
+            task();
+            task_ns = now_ns() - begin;
+        };
+        cv_.notify_all();
+        cv_.wait(lock, [this, idx]() { return !tasks_[idx]; });
+        return task_ns;
+    }
+
+    ~helper_threads() {
+        {
+            std::lock_guard lock(mtx_);
+            done_ = true;
+        }
+        cv_.notify_all();
+        for (auto& thread : threads_)
+        {
+            thread.join();
+        }
+    }
+};
+
+static bool read_record(const char* path, std::vector<record_entry>& entries) {
+    FILE* in = fopen(path, "rb");
+    if (in == NULL)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+
+    char magic[RECORD_MAGIC_LEN];
+    if (fread(magic, 1, RECORD_MAGIC_LEN, in) != RECORD_MAGIC_LEN || memcmp(magic, RECORD_MAGIC, RECORD_MAGIC_LEN) != 0)
+    {
+        fprintf(stderr, "%s is not a gc record\n", path);
+        fclose(in);
+        return false;
+    }
+
+    record_entry buf[4096];
+    size_t cnt;
+    while ((cnt = fread(buf, sizeof(record_entry), 4096, in)) > 0)
+    {
+        entries.insert(entries.end(), buf, buf + cnt);
+    }
+    fclose(in);
+    return true;
+}
+
+static double percentile(std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) { return 0; }
+    size_t idx = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+    return static_cast<double>(sorted[idx]) / 1000.0;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <record file>\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<record_entry> entries;
+    if (!read_record(argv[1], entries)) { return 1; }
+    if (entries.empty())
+    {
+        printf("Record is empty\n");
+        return 0;
+    }
+
+    uint32_t threads_cnt = 0;
+    for (const auto& entry : entries)
+    {
+        threads_cnt = std::max(threads_cnt, entry.tid + 1);
+    }
+    helper_threads helpers(threads_cnt);
+
+    gc_handler handler = gc_get_handler();
+    std::vector<bool> created(threads_cnt, false);
+    std::unordered_map<uint64_t, void**> slots;        // recorded variable -> replay variable
+    std::unordered_map<uint64_t, void*> objects;       // recorded block -> replay block
+    std::vector<std::vector<uint64_t>> durations(RECORD_KINDS_CNT);
+
+    auto slot = [&slots](uint64_t addr) -> void** {
+        auto itr = slots.find(addr);
+        if (itr != slots.end()) { return itr->second; }
+        void** var = new void*(NULL);
+        slots.insert({addr, var});
+        return var;
+    };
+
+    uint64_t replay_begin = now_ns();
+    for (const auto& entry : entries)
+    {
+        size_t kind = static_cast<size_t>(entry.kind);
+        if (kind >= RECORD_KINDS_CNT) { continue; }
+
+        pthread_t tid = helpers.tid(entry.tid);
+        if (!created[entry.tid] && entry.kind != RECORD_KIND::CREATE && entry.kind != RECORD_KIND::STOP)
+        {
+            // Recording started after this heap was created
+            helpers.run(entry.tid, [tid]() { gc_create(tid); });
+            created[entry.tid] = true;
+        }
+
+        void** var = NULL;
+        uint64_t begin = now_ns();
+        uint64_t elapsed = 0;
+        switch (entry.kind)
+        {
+        case RECORD_KIND::CREATE:
+            elapsed = helpers.run(entry.tid, [tid, &entry]() { gc_create_ex(tid, static_cast<int>(entry.size)); });
+            created[entry.tid] = true;
+            break;
+        case RECORD_KIND::STOP:
+            elapsed = helpers.run(entry.tid, [tid]() { gc_stop(tid); });
+            created[entry.tid] = false;
+            break;
+        case RECORD_KIND::MALLOC:
+            var = slot(entry.slot);
+            handler.gc_malloc(tid, var, entry.size);
+            break;
+        case RECORD_KIND::CALLOC:
+            var = slot(entry.slot);
+            handler.gc_calloc(tid, var, 1, entry.size);
+            break;
+        case RECORD_KIND::REALLOC:
+            var = slot(entry.slot);
+            handler.gc_realloc(tid, var, entry.size);
+            break;
+        case RECORD_KIND::FREE:
+        {
+            auto itr = objects.find(entry.obj);
+            if (itr != objects.end())
+            {
+                handler.gc_free(tid, itr->second);
+                objects.erase(itr);
+            }
+            break;
+        }
+        case RECORD_KIND::MARK_ROOT:
+            handler.mark_root(tid, slot(entry.obj));
+            break;
+        case RECORD_KIND::UNMARK_ROOT:
+            handler.unmark_root(tid, slot(entry.obj));
+            break;
+        case RECORD_KIND::COLLECT:
+            handler.collect(tid, static_cast<int>(entry.size));
+            break;
+        }
+        if (elapsed == 0) { elapsed = now_ns() - begin; }
+        durations[kind].push_back(elapsed);
+
+        if (var != NULL && *var != NULL)
+        {
+            // Stale bytes would look like pointers to the conservative scan, so new memory is cleared untimed
+            if (entry.kind == RECORD_KIND::MALLOC)
+            {
+                memset(*var, 0, entry.size);
+            }
+            objects[entry.obj] = *var;
+        }
+    }
+    uint64_t replay_ns = now_ns() - replay_begin;
+
+    for (uint32_t i = 0; i < threads_cnt; i++)
+    {
+        if (created[i])
+        {
+            pthread_t tid = helpers.tid(i);
+            helpers.run(i, [tid]() { gc_stop(tid); });
+        }
+    }
+    for (auto& [addr, var] : slots)
+    {
+        delete var;
+    }
+
+    uint64_t recorded_ns = entries.back().ts_ns - entries.front().ts_ns;
+    printf("events: %zu, threads: %u\n", entries.size(), threads_cnt);
+    printf("recorded span: %.3f ms, replay time: %.3f ms, throughput: %.0f ops/s\n",
+           static_cast<double>(recorded_ns) / 1e6,
+           static_cast<double>(replay_ns) / 1e6,
+           static_cast<double>(entries.size()) / (static_cast<double>(replay_ns) / 1e9));
+
+    printf("%-12s %10s %12s %10s %10s %10s %10s\n", "event", "count", "total ms", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (size_t kind = 0; kind < RECORD_KINDS_CNT; kind++)
+    {
+        std::vector<uint64_t>& times = durations[kind];
+        if (times.empty()) { continue; }
+
+        std::sort(times.begin(), times.end());
+        uint64_t total = 0;
+        for (auto t : times) { total += t; }
+        printf("%-12s %10zu %12.3f %10.2f %10.2f %10.2f %10.2f\n",
+               kind_name[kind], times.size(),
+               static_cast<double>(total) / 1e6,
+               percentile(times, 0.5), percentile(times, 0.99), percentile(times, 0.999),
+               static_cast<double>(times.back()) / 1000.0);
+    }
+    return 0;
+}